@@ -0,0 +1,90 @@
+/******************************************************************************
+ *  Copyright (C) 2019 - Haohua Dong & Diogo Antunes
+ *
+ *  This file is a part of GeneralStack.
+ *
+ *  GeneralStack is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  GeneralStack is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * DESCRIPTION
+ *  Times itemExistsParallel searching for a missing item, so that every item
+ *  is compared, on a deep Stack with 1, 2, 4 and 8 threads.
+ *      cc -O2 -o parallelBench bench/parallelBench.c generalStack.c -lm -pthread
+ *  Arguments: megabytes of items (default 512) and number of searches timed
+ *  for each number of threads (default 5).
+ *
+ *****************************************************************************/
+
+// clock_gettime, also when built as strict ISO C
+#define _POSIX_C_SOURCE 200809L
+
+#include "../generalStack.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+typedef struct {
+  long key;
+  long value;
+} Item;
+
+static int equalItems(void *a, void *b) {
+  return ((Item *)a)->key == ((Item *)b)->key;
+}
+
+static double now(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+int main(int argc, char **argv) {
+  static const size_t threads[] = {1, 2, 4, 8};
+  size_t megabytes, runs, count, j, t;
+  double start, elapsed, best, single;
+  Stack *stack;
+  Item item;
+
+  megabytes = argc > 1 ? strtoul(argv[1], NULL, 10) : 512;
+  runs = argc > 2 ? strtoul(argv[2], NULL, 10) : 5;
+
+  count = megabytes * (1 << 20) / sizeof(Item);
+  stack = initStack(1024, sizeof(Item));
+  for (j = 0; j < count; j++) {
+    item.key = (long)j;
+    item.value = 0;
+    push(stack, &item);
+  }
+
+  item.key = -1;
+  single = 0;
+  for (t = 0; t < sizeof(threads) / sizeof(threads[0]); t++) {
+    best = 0;
+    for (j = 0; j < runs; j++) {
+      start = now();
+      if (itemExistsParallel(stack, &item, -1, equalItems, threads[t], NULL))
+        return 1;
+      elapsed = now() - start;
+      if (j == 0 || elapsed < best)
+        best = elapsed;
+    }
+    if (t == 0)
+      single = best;
+    printf("%zu MB, %zu threads: best %.1f ms, speedup %.2f\n", megabytes,
+           threads[t], best * 1e3, single / best);
+  }
+  freeStack(stack);
+  return 0;
+}
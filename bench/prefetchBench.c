@@ -0,0 +1,90 @@
+/******************************************************************************
+ *  Copyright (C) 2019 - Haohua Dong & Diogo Antunes
+ *
+ *  This file is a part of GeneralStack.
+ *
+ *  GeneralStack is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  GeneralStack is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * DESCRIPTION
+ *  Times itemExists searching for a missing item, so that every table is
+ *  scanned, on a Stack much larger than the last level cache. Build it once
+ *  as is and once with prefetching disabled to compare the two:
+ *      cc -O2 -o prefetchBench bench/prefetchBench.c generalStack.c -lm -pthread
+ *      cc -O2 '-DPREFETCH(addr)=' -o noPrefetchBench bench/prefetchBench.c \
+ *          generalStack.c -lm -pthread
+ *  Arguments: megabytes of items (default 512), initial table size in items
+ *  (default 64) and number of searches timed (default 10).
+ *
+ *****************************************************************************/
+
+// clock_gettime, also when built as strict ISO C
+#define _POSIX_C_SOURCE 200809L
+
+#include "../generalStack.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+typedef struct {
+  long key;
+  long value;
+} Item;
+
+static int equalItems(void *a, void *b) {
+  return ((Item *)a)->key == ((Item *)b)->key;
+}
+
+static double now(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+int main(int argc, char **argv) {
+  size_t megabytes, initial, runs, count, j;
+  double start, elapsed, best;
+  Stack *stack;
+  Item item;
+
+  megabytes = argc > 1 ? strtoul(argv[1], NULL, 10) : 512;
+  initial = argc > 2 ? strtoul(argv[2], NULL, 10) : 64;
+  runs = argc > 3 ? strtoul(argv[3], NULL, 10) : 10;
+
+  count = megabytes * (1 << 20) / sizeof(Item);
+  stack = initStack(initial, sizeof(Item));
+  for (j = 0; j < count; j++) {
+    item.key = (long)j;
+    item.value = 0;
+    push(stack, &item);
+  }
+
+  item.key = -1;
+  best = 0;
+  for (j = 0; j < runs; j++) {
+    start = now();
+    if (itemExists(stack, &item, -1, equalItems))
+      return 1;
+    elapsed = now() - start;
+    if (j == 0 || elapsed < best)
+      best = elapsed;
+  }
+  printf("%zu MB, %zu items, initial table %zu: best %.1f ms, %.2f GB/s\n",
+         megabytes, count, initial, best * 1e3,
+         count * sizeof(Item) / best / 1e9);
+  freeStack(stack);
+  return 0;
+}
@@ -0,0 +1,105 @@
+/******************************************************************************
+ *  Copyright (C) 2019 - Haohua Dong & Diogo Antunes
+ *
+ *  This file is a part of GeneralStack.
+ *
+ *  GeneralStack is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  GeneralStack is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * DESCRIPTION
+ *  Times streaming a deep Stack through its spill file, see setStackSpill:
+ *  pushing it, scanning it with itemExists and popping it back, compared with
+ *  the same Stack kept in memory.
+ *      cc -O2 -o spillBench bench/spillBench.c generalStack.c -lm -pthread
+ *  Arguments: megabytes of items (default 512) and number of tables kept in
+ *  memory while spilling (default 4).
+ *
+ *****************************************************************************/
+
+// clock_gettime, also when built as strict ISO C
+#define _POSIX_C_SOURCE 200809L
+
+#include "../generalStack.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+typedef struct {
+  long key;
+  long value;
+} Item;
+
+static int equalItems(void *a, void *b) {
+  return ((Item *)a)->key == ((Item *)b)->key;
+}
+
+static double now(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+/* Description: Pushes, scans and pops count items, spilling all but
+ * hot_tables tables if hot_tables is not 0, and prints the throughput of each
+ * step.
+ * Return: 0 on success, 1 if the Stack did not give its items back.
+ * */
+static int run(size_t count, size_t hot_tables) {
+  double start, pushed, scanned, popped, megabytes;
+  Stack *stack;
+  Item item;
+  size_t j;
+
+  stack = initStack(4096, sizeof(Item));
+  if (hot_tables != 0 && setStackSpill(stack, hot_tables) != STACK_OK)
+    return 1;
+
+  start = now();
+  for (j = 0; j < count; j++) {
+    item.key = (long)j;
+    item.value = 0;
+    push(stack, &item);
+  }
+  pushed = now();
+  item.key = -1;
+  if (itemExists(stack, &item, -1, equalItems))
+    return 1;
+  scanned = now();
+  for (j = count; j > 0; j--) {
+    pop(stack, &item);
+    if (item.key != (long)j - 1)
+      return 1;
+  }
+  popped = now();
+  freeStack(stack);
+
+  megabytes = count * sizeof(Item) / (double)(1 << 20);
+  printf("%-9s push %7.1f MB/s, scan %7.1f MB/s, pop %7.1f MB/s\n",
+         hot_tables != 0 ? "spilled" : "in memory", megabytes / (pushed - start),
+         megabytes / (scanned - pushed), megabytes / (popped - scanned));
+  return 0;
+}
+
+int main(int argc, char **argv) {
+  size_t megabytes, hot_tables, count;
+
+  megabytes = argc > 1 ? strtoul(argv[1], NULL, 10) : 512;
+  hot_tables = argc > 2 ? strtoul(argv[2], NULL, 10) : 4;
+  if (hot_tables == 0)
+    hot_tables = 1;
+
+  count = megabytes * (1 << 20) / sizeof(Item);
+  printf("%zu MB, %zu tables kept in memory\n", megabytes, hot_tables);
+  return run(count, 0) || run(count, hot_tables);
+}
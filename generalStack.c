@@ -24,115 +24,2200 @@
  *  Implementation details:
  *      The stack is implemented via a list of tables. When a table fills,
  *      another one is allocated and the new table's size grows linearly. The
- *      Stack always has at least the starting table allocated.
+ *      Stack always has at least the starting table allocated. Emptied tables
+ *      can optionally be kept as spare capacity for later pushes. Tables are
+ *      aligned to cache lines, and very large ones are mapped on huge pages.
+ *      Cold tables at the bottom can optionally be spilled to a temporary file,
+ *      or compressed in memory with a small LZ4-style codec. Snapshots share
+ *      the tables in memory, with a reference count, until a push writes
+ *      into a shared one. Adjacent tables can be merged by compaction, which
+ *      then leaves tables of uneven sizes.
+ *      A Stack can instead keep all of its tables mapped from a backing file,
+ *      appended after a header page, so it can be reopened later in place.
  *
  *****************************************************************************/
 
+// POSIX functions and mmap flags, also when built as strict ISO C
+#define _POSIX_C_SOURCE 200809L
+#define _DEFAULT_SOURCE
+
 #include "generalStack.h"
 
+#include <limits.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#ifdef __unix__
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Bytes before the end of a table at which itemExists prefetches the next one
+#define PREFETCH_DISTANCE 512
+// Can be defined empty at build time to compare against no prefetching
+#ifndef PREFETCH
+#ifdef __GNUC__
+#define PREFETCH(addr) __builtin_prefetch(addr, 0, 0)
+#else
+#define PREFETCH(addr)
+#endif
+#endif
+// Default alignment of the tables, one cache line
+#define DEFAULT_ALIGNMENT 64
+// Default size from which tables are mapped on huge pages
+#define DEFAULT_HUGE_THRESHOLD (64 << 20)
+// Bytes before the items of each table of a backing file, holding its size
+#define FILE_TABLE_HEADER 64
+// Identifies backing files, see openStackFile
+#define FILE_MAGIC "GSTACK1"
+// Identifies saved Stacks, see saveStack
+#define SAVE_MAGIC "GSTKSV1"
+// Number of entries of the match finder of the compressor, a power of two
+#define LZ_HASH_SIZE 4096
+// Shortest match the compressor encodes
+#define LZ_MIN_MATCH 4
 
 struct node {
-  void *Items;       // Pointer to table of items
-  struct node *next; // Pointer to next node.
+  void *Items;           // Pointer to table of items, NULL if spilled
+  size_t n;              // Size of this table
+  int mapped;            // 1 if Items was allocated with mmap, 2 if from a file
+  size_t offset;         // Position of the table in the spill or backing file
+  void *packed;          // Compressed items, if spilled with setStackCompress
+  size_t packedSize;     // Size of packed in bytes
+  atomic_size_t *shared; // References to Items if shared by snapshots, or NULL
+  struct node *next;     // Pointer to next node.
+  struct node *prev;     // Pointer to previous node, NULL for the head.
 };
 struct _stack {
-  struct node *head;        // List of tables
-  unsigned int i;           // First empty space index
-  unsigned int n;           // Current table size
-  unsigned int itemSize;    // Size of each item to be stored.
-  unsigned int initialSize; // Initial size of the Stack.
+  struct node *head;             // List of tables
+  struct node *tail;             // Last table of the list, the starting one
+  struct node *spare;            // Released tables kept for reuse
+  size_t i;                      // First empty space index
+  size_t n;                      // Current table size
+  size_t itemSize;               // Size of each item to be stored.
+  size_t initialSize;            // Initial size of the Stack.
+  size_t count;                  // Number of items in the Stack
+  size_t nSpare;                 // Number of tables in spare
+  size_t maxSpare;               // Maximum number of tables kept in spare
+  unsigned char *filter;         // Counting Bloom filter of the items, or NULL
+  size_t filterSize;             // Number of counters in filter
+  size_t filterHashes;           // Number of counters set per item
+  unsigned long (*hash)(void *); // Hash function used by filter
+  size_t alignment;              // Alignment of new tables in bytes
+  size_t hugeThreshold;          // Size from which new tables are mapped
+  size_t tableBytes;             // Bytes of all tables, spare ones included
+  size_t maxItems;               // Maximum number of items
+  size_t maxBytes;               // Maximum value of tableBytes
+  StackBudget *budget;           // Budget shared with other Stacks, or NULL
+  size_t nResident;              // Number of tables in memory
+  size_t hotTables;              // Tables kept in memory, 0 to never spill
+  FILE *spillFile;               // File where cold tables are spilled
+  size_t spillBytes;             // Bytes in use in spillFile
+  int compress;                  // 1 if cold tables are compressed instead
+  size_t compactTables;          // Tables in memory that trigger compaction
+  size_t compactStep;            // Tables merged by each automatic compaction
+  struct node *garbage;          // Released tables not freed yet
+  size_t freePerOp;              // Tables freed per push or pop, 0 to not defer
+  struct node *spillTop;         // Topmost spilled table, NULL if none
+  void *scratch;                 // Buffer where spilled tables are read
+  size_t scratchSize;            // Size of scratch in bytes
+  struct node *scratchNode;      // Spilled table currently in scratch
+  int fileFd;                    // Backing file of the tables, -1 if none
+  struct fileHeader *fileHeader; // Mapped header of the backing file
+  size_t filePage;               // Granularity of the tables in the file
+  size_t fileEnd;                // End of the tables in the backing file
+  size_t fileSize;               // Size of the backing file, up to syncStack
+};
+/* Header at the start of a backing file. The tables follow it in order from
+ * the bottom of the Stack, each starting at a multiple of pageSize with its
+ * size in items, so the file is its own table directory. */
+struct fileHeader {
+  char magic[8];        // FILE_MAGIC
+  uint64_t itemSize;    // Size of each item
+  uint64_t initialSize; // Initial size of the Stack
+  uint64_t pageSize;    // Granularity of the tables in the file
+  uint64_t count;       // Number of items, as of the last sync
+  uint64_t fill;        // Items in the topmost table, as of the last sync
+  uint64_t tables;      // Number of tables, as of the last sync
+};
+/* Header of a saved Stack, followed by its items from the bottom up. */
+struct saveHeader {
+  char magic[8];        // SAVE_MAGIC
+  uint64_t itemSize;    // Size of each item
+  uint64_t initialSize; // Initial size of the Stack
+  uint64_t count;       // Number of items
+};
+/* Table of a persistent Stack. Versions sharing the items below fill point to
+ * the same chunk, and a chunk's items are never modified once written. */
+struct pchunk {
+  atomic_size_t refs;    // Versions and chunks referencing this chunk
+  atomic_size_t used;    // Items written to the chunk, by any version
+  size_t n;              // Size of the chunk in items
+  struct pchunk *parent; // Chunk below this one, NULL for the bottom one
+  size_t parentFill;     // Items of parent below this chunk
+  unsigned char Items[]; // Items of the chunk
+};
+struct _pstack {
+  struct pchunk *chunk; // Topmost chunk, NULL if the version is empty
+  size_t fill;          // Items of chunk in this version
+  size_t itemSize;      // Size of each item
+  size_t initialSize;   // Size of the first chunk
+};
+struct _minMaxStack {
+  Stack *items;                   // Items of the Stack
+  Stack *mins;                    // Items that were the minimum when pushed
+  Stack *maxs;                    // Items that were the maximum when pushed
+  int (*compare)(void *, void *); // Orders the items
 };
+struct _stackBudget {
+  atomic_size_t used; // Bytes of tables charged to the budget
+  size_t maxBytes;    // Maximum value of used
+};
+/* State shared by the threads of itemExistsParallel. */
+struct parallelSearch {
+  struct node **tables;         // Tables from the top of the Stack
+  size_t *counts;               // Number of items in each table
+  size_t itemSize;              // Size of each item
+  void *item;                   // Item to search for
+  int (*equal)(void *, void *); // Function used to compare the items
+  atomic_size_t best;           // Depth of the topmost match, SIZE_MAX if none
+};
+/* Range of depths searched by one thread of itemExistsParallel. */
+struct searchRange {
+  struct parallelSearch *search;
+  size_t table;      // Table holding the item at depth lo
+  size_t tableDepth; // Depth of the top item of that table
+  size_t lo, hi;     // Depths to search, hi excluded
+  pthread_t thread;
+};
+/* Description: Returns the bytes a table of n items takes in a backing file.
+ * */
+static size_t fileRegion(Stack *stack, size_t n) {
+  size_t bytes;
+
+  bytes = FILE_TABLE_HEADER + n * stack->itemSize;
+  return (bytes + stack->filePage - 1) / stack->filePage * stack->filePage;
+}
+/* Description: Allocates the items of a table, aligned to the Stack's
+ * alignment. Tables of at least hugeThreshold bytes are mapped directly and
+ * backed by huge pages where the system supports it. Stacks with a backing
+ * file append the table to the file and map it instead.
+ * Return: 1 on success, 0 if the items could not be allocated.
+ * */
+static int allocItems(Stack *stack, struct node *node) {
+  size_t bytes;
+#ifdef __unix__
+  size_t region;
+  void *map;
+#endif
+
+  bytes = node->n * stack->itemSize;
+  node->mapped = 0;
+#ifdef __unix__
+  if (stack->fileFd >= 0) {
+    region = fileRegion(stack, node->n);
+    // The file only grows here, released tables are cut off by syncStack
+    if (stack->fileEnd + region > stack->fileSize) {
+      if (ftruncate(stack->fileFd, (off_t)(stack->fileEnd + region)) != 0)
+        return 0;
+      stack->fileSize = stack->fileEnd + region;
+    }
+    map = mmap(NULL, region, PROT_READ | PROT_WRITE, MAP_SHARED, stack->fileFd,
+               (off_t)stack->fileEnd);
+    if (map == MAP_FAILED) {
+      node->Items = NULL;
+      return 0;
+    }
+    *(uint64_t *)map = node->n;
+    node->Items = (char *)map + FILE_TABLE_HEADER;
+    node->offset = stack->fileEnd;
+    node->mapped = 2;
+    stack->fileEnd += region;
+  } else if (stack->hugeThreshold != 0 && bytes >= stack->hugeThreshold) {
+    node->Items = mmap(NULL, bytes, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (node->Items == MAP_FAILED) {
+      node->Items = NULL;
+      return 0;
+    }
+#ifdef MADV_HUGEPAGE
+    madvise(node->Items, bytes, MADV_HUGEPAGE);
+#endif
+    node->mapped = 1;
+  } else if (posix_memalign(&node->Items, stack->alignment, bytes) != 0) {
+    node->Items = NULL;
+    return 0;
+  }
+#else
+  node->Items = malloc(bytes);
+  if (node->Items == NULL)
+    return 0;
+#endif
+  stack->tableBytes += bytes;
+  return 1;
+}
+/* Description: Frees the items of a table, returning their bytes to the
+ * Stack's budget. Items shared with snapshots are only released.
+ * */
+static void freeItems(Stack *stack, struct node *node) {
+  stack->tableBytes -= node->n * stack->itemSize;
+  if (stack->budget != NULL)
+    atomic_fetch_sub(&stack->budget->used, node->n * stack->itemSize);
+  if (node->shared != NULL) {
+    // Only the last reference frees the items
+    if (atomic_fetch_sub(node->shared, 1) != 1) {
+      node->shared = NULL;
+      node->Items = NULL;
+      return;
+    }
+    free(node->shared);
+    node->shared = NULL;
+  }
+#ifdef __unix__
+  if (node->mapped == 2)
+    munmap((char *)node->Items - FILE_TABLE_HEADER, fileRegion(stack, node->n));
+  else if (node->mapped)
+    munmap(node->Items, node->n * stack->itemSize);
+  else
+#endif
+    free(node->Items);
+  node->Items = NULL;
+}
+/* Description: Allocates a table able to hold n items, see allocItems.
+ * Return: The new table, or NULL if it could not be allocated.
+ * */
+static struct node *allocTable(Stack *stack, size_t n) {
+  struct node *new_node;
+
+  // Check for overflow of the table's size in bytes
+  if (stack->itemSize != 0 && n > SIZE_MAX / stack->itemSize)
+    return NULL;
+
+  new_node = (struct node *)malloc(sizeof(struct node));
+  if (new_node == NULL)
+    return NULL;
+
+  new_node->n = n;
+  new_node->packed = NULL;
+  new_node->shared = NULL;
+  if (!allocItems(stack, new_node)) {
+    free(new_node);
+    return NULL;
+  }
+  return new_node;
+}
+/* Description: Gives the head table items of its own, copying them if they
+ * are still shared with a snapshot, before a push writes into it.
+ * Return: 1 on success, 0 if the items could not be allocated.
+ * */
+static int unshareTable(Stack *stack, struct node *node) {
+  struct node old;
+
+  if (atomic_load(node->shared) == 1) {
+    free(node->shared);
+    node->shared = NULL;
+    return 1;
+  }
+  old = *node;
+  if (!allocItems(stack, node)) {
+    *node = old;
+    return 0;
+  }
+  memcpy(node->Items, old.Items, stack->i * stack->itemSize);
+  node->shared = NULL;
+  // Releasing the shared items returns their bytes, the copy keeps them
+  if (stack->budget != NULL)
+    atomic_fetch_add(&stack->budget->used, node->n * stack->itemSize);
+  freeItems(stack, &old);
+  return 1;
+}
+/* Description: Frees a table and its items, if they are in memory.
+ * */
+static void freeTable(Stack *stack, struct node *old) {
+  if (old->Items != NULL)
+    freeItems(stack, old);
+  free(old->packed);
+  free(old);
+}
+/* Description: Charges bytes to a budget, unless that would exceed it.
+ * Return: 1 if the bytes were charged, 0 otherwise.
+ * */
+static int budgetCharge(StackBudget *budget, size_t bytes) {
+  size_t used;
+
+  used = atomic_load(&budget->used);
+  do {
+    if (used > budget->maxBytes || bytes > budget->maxBytes - used)
+      return 0;
+  } while (!atomic_compare_exchange_weak(&budget->used, &used, used + bytes));
+  return 1;
+}
+/* Description: Returns a table able to hold n items. Reuses a spare table if
+ * there is one, in which case the table's size may differ from n. Otherwise
+ * the new table must fit in the Stack's byte limit and budget.
+ * Arguments: Pointer to the Stack, the size of the table in items, and pointer
+ * where the reason of a failure is stored.
+ * Return: The table, or NULL if it could not be allocated.
+ * */
+static struct node *newTable(Stack *stack, size_t n, StackStatus *status) {
+  struct node *new_node;
+  size_t bytes;
+
+  if (stack->spare != NULL) {
+    new_node = stack->spare;
+    stack->spare = new_node->next;
+    stack->nSpare--;
+    return new_node;
+  }
+
+  if (stack->itemSize != 0 && n > SIZE_MAX / stack->itemSize) {
+    *status = STACK_OVERFLOW;
+    return NULL;
+  }
+  bytes = n * stack->itemSize;
+  if (stack->tableBytes > stack->maxBytes ||
+      bytes > stack->maxBytes - stack->tableBytes ||
+      (stack->budget != NULL && !budgetCharge(stack->budget, bytes))) {
+    *status = STACK_FULL;
+    return NULL;
+  }
+  new_node = allocTable(stack, n);
+  if (new_node == NULL) {
+    if (stack->budget != NULL)
+      atomic_fetch_sub(&stack->budget->used, bytes);
+    *status = STACK_NO_MEMORY;
+  }
+  return new_node;
+}
+/* Description: Frees a table just removed from the top of the list, or keeps
+ * it in the spare list if the Stack still has room for spare tables. If the
+ * Stack defers freeing, the table is kept for reclaimTables instead.
+ * */
+static void releaseTable(Stack *stack, struct node *old) {
+  if (old->Items == NULL) {
+    // Spilled tables are always the topmost of the spill file
+    stack->spillTop = old->next;
+    if (!stack->compress)
+      stack->spillBytes = old->offset;
+    if (stack->scratchNode == old)
+      stack->scratchNode = NULL;
+    free(old->packed);
+    free(old);
+    return;
+  }
+  stack->nResident--;
+  if (stack->fileFd >= 0) {
+    // Tables of a backing file are freed in the order they were appended. The
+    // file keeps them until syncStack, as its header may still count them.
+    stack->fileEnd = old->offset;
+    freeTable(stack, old);
+    return;
+  }
+  // Shared tables are not reused, as pushes would write into them
+  if (stack->nSpare < stack->maxSpare && old->shared == NULL) {
+    old->next = stack->spare;
+    stack->spare = old;
+    stack->nSpare++;
+    return;
+  }
+  if (stack->freePerOp != 0) {
+    old->next = stack->garbage;
+    stack->garbage = old;
+    return;
+  }
+  freeTable(stack, old);
+}
+/* Description: Frees at most k of the tables whose release was deferred.
+ * */
+static void reclaimTables(Stack *stack, size_t k) {
+  struct node *old;
+
+  for (; k > 0 && stack->garbage != NULL; k--) {
+    old = stack->garbage;
+    stack->garbage = old->next;
+    freeTable(stack, old);
+  }
+}
+/* Description: Writes the extra bytes of a length that did not fit in its
+ * 4 bits of a token, see lzCompress.
+ * Return: Position after the length, NULL if it does not fit before end.
+ * */
+static unsigned char *lzLength(unsigned char *op, unsigned char *end,
+                               size_t len) {
+  for (; len >= 255; len -= 255) {
+    if (op == end)
+      return NULL;
+    *op++ = 255;
+  }
+  if (op == end)
+    return NULL;
+  *op++ = (unsigned char)len;
+  return op;
+}
+/* Description: Writes a sequence of literals followed by a match, or by
+ * nothing if match_len is 0, see lzCompress.
+ * Return: Position after the sequence, NULL if it does not fit before end.
+ * */
+static unsigned char *lzSequence(unsigned char *op, unsigned char *end,
+                                 const unsigned char *lit, size_t lit_len,
+                                 size_t offset, size_t match_len) {
+  unsigned char *token;
+
+  if (op == end)
+    return NULL;
+  token = op++;
+  *token = (unsigned char)((lit_len < 15 ? lit_len : 15) << 4);
+  if (lit_len >= 15 && (op = lzLength(op, end, lit_len - 15)) == NULL)
+    return NULL;
+  if ((size_t)(end - op) < lit_len)
+    return NULL;
+  memcpy(op, lit, lit_len);
+  op += lit_len;
+  if (match_len == 0)
+    return op;
+
+  if (end - op < 2)
+    return NULL;
+  *op++ = (unsigned char)(offset & 255);
+  *op++ = (unsigned char)(offset >> 8);
+  match_len -= LZ_MIN_MATCH;
+  *token |= (unsigned char)(match_len < 15 ? match_len : 15);
+  if (match_len >= 15)
+    op = lzLength(op, end, match_len - 15);
+  return op;
+}
+/* Description: Compresses a buffer with a byte oriented LZ77 codec in the
+ * LZ4 block format: each sequence is a token holding the number of literals
+ * and the length of the match in 4 bits each, the literals, and the match as
+ * a 16 bit offset back into the output. The last sequence has no match.
+ * Arguments: The buffer and its size, the destination and its capacity.
+ * Return: The size of the compressed data, 0 if it does not fit in capacity.
+ * */
+static size_t lzCompress(const unsigned char *src, size_t size,
+                         unsigned char *dst, size_t capacity) {
+  size_t table[LZ_HASH_SIZE];
+  size_t p, anchor, cand, len, misses;
+  unsigned char *op, *end;
+  uint32_t seq;
+
+  memset(table, 0, sizeof(table));
+  op = dst;
+  end = dst + capacity;
+  p = 0;
+  anchor = 0;
+  misses = 0;
+  while (p + LZ_MIN_MATCH <= size) {
+    memcpy(&seq, src + p, sizeof(seq));
+    seq = (seq * 2654435761u) >> 20;
+    cand = table[seq];
+    table[seq] = p;
+    if (cand >= p || p - cand > 65535 ||
+        memcmp(src + cand, src + p, LZ_MIN_MATCH) != 0) {
+      // Skip faster through data that does not compress
+      p += 1 + (misses++ >> 6);
+      continue;
+    }
+    len = LZ_MIN_MATCH;
+    while (p + len < size && src[cand + len] == src[p + len])
+      len++;
+    op = lzSequence(op, end, src + anchor, p - anchor, p - cand, len);
+    if (op == NULL)
+      return 0;
+    p += len;
+    anchor = p;
+    misses = 0;
+  }
+  op = lzSequence(op, end, src + anchor, size - anchor, 0, 0);
+  return op != NULL ? (size_t)(op - dst) : 0;
+}
+/* Description: Reads the extra bytes of a length, see lzLength.
+ * Return: 1 on success, 0 if the input ended first.
+ * */
+static int lzReadLength(const unsigned char **ip, const unsigned char *end,
+                        size_t *len) {
+  unsigned char b;
+
+  do {
+    if (*ip == end)
+      return 0;
+    b = *(*ip)++;
+    *len += b;
+  } while (b == 255);
+  return 1;
+}
+/* Description: Decompresses data written by lzCompress.
+ * Arguments: The compressed data and its size, the destination and the size
+ * of the decompressed data.
+ * Return: 1 on success, 0 if the data is corrupt.
+ * */
+static int lzDecompress(const unsigned char *src, size_t size,
+                        unsigned char *dst, size_t dst_size) {
+  const unsigned char *ip, *end;
+  size_t o, len, offset;
+  unsigned char token;
+
+  ip = src;
+  end = src + size;
+  o = 0;
+  while (ip < end) {
+    token = *ip++;
+    len = token >> 4;
+    if (len == 15 && !lzReadLength(&ip, end, &len))
+      return 0;
+    if (len > (size_t)(end - ip) || len > dst_size - o)
+      return 0;
+    memcpy(dst + o, ip, len);
+    ip += len;
+    o += len;
+    if (ip == end)
+      break;
+
+    if (end - ip < 2)
+      return 0;
+    offset = ip[0] | (size_t)ip[1] << 8;
+    ip += 2;
+    len = token & 15;
+    if (len == 15 && !lzReadLength(&ip, end, &len))
+      return 0;
+    len += LZ_MIN_MATCH;
+    if (offset == 0 || offset > o || len > dst_size - o)
+      return 0;
+    if (offset >= len) {
+      memcpy(dst + o, dst + o - offset, len);
+      o += len;
+    } else {
+      // Overlapping match, repeating the last offset bytes
+      for (; len > 0; len--, o++)
+        dst[o] = dst[o - offset];
+    }
+  }
+  return o == dst_size;
+}
+/* Description: Compresses the items of a table into its packed buffer. Items
+ * that do not compress are stored as they are. Compressed items are always
+ * smaller than the table, which is how unpackTable tells the two apart.
+ * Return: 1 on success, 0 if the buffer could not be allocated.
+ * */
+static int packTable(Stack *stack, struct node *node) {
+  size_t bytes, size;
+  void *packed;
+
+  bytes = node->n * stack->itemSize;
+  node->packed = malloc(bytes != 0 ? bytes : 1);
+  if (node->packed == NULL)
+    return 0;
+  size = bytes != 0 ? lzCompress(node->Items, bytes, node->packed, bytes - 1)
+                    : 0;
+  if (size == 0) {
+    memcpy(node->packed, node->Items, bytes);
+    size = bytes;
+  }
+  packed = realloc(node->packed, size != 0 ? size : 1);
+  if (packed != NULL)
+    node->packed = packed;
+  node->packedSize = size;
+  return 1;
+}
+/* Description: Decompresses the items of a packed table into dest.
+ * Return: 1 on success, 0 if the packed data is corrupt.
+ * */
+static int unpackTable(Stack *stack, struct node *node, void *dest) {
+  size_t bytes;
+
+  bytes = node->n * stack->itemSize;
+  if (node->packedSize == bytes) {
+    memcpy(dest, node->packed, bytes);
+    return 1;
+  }
+  return lzDecompress(node->packed, node->packedSize, dest, bytes);
+}
+/* Description: Writes the lowest table still in memory to the end of the spill
+ * file, or compresses it if the Stack compresses cold tables, and frees its
+ * items. Spilled tables are contiguous from the tail up to spillTop, and the
+ * spill file holds them in that order.
+ * Return: 1 if a table was spilled, 0 otherwise.
+ * */
+static int spillTable(Stack *stack) {
+  struct node *node;
+  size_t bytes;
+
+  node = stack->spillTop != NULL ? stack->spillTop->prev : stack->tail;
+  if (node == NULL || node == stack->head)
+    return 0;
+
+  bytes = node->n * stack->itemSize;
+  if (stack->compress) {
+    if (!packTable(stack, node))
+      return 0;
+  } else {
+#ifdef __unix__
+    if (pwrite(fileno(stack->spillFile), node->Items, bytes,
+               (off_t)stack->spillBytes) != (ssize_t)bytes)
+      return 0;
+    node->offset = stack->spillBytes;
+    stack->spillBytes += bytes;
+#else
+    return 0;
+#endif
+  }
+  freeItems(stack, node);
+  stack->spillTop = node;
+  stack->nResident--;
+  return 1;
+}
+/* Description: Reads spillTop back into memory, as it is about to be used.
+ * Its bytes are charged to the Stack's budget even if that exceeds it.
+ * Return: STACK_OK, STACK_NO_MEMORY, or STACK_IO_ERROR if reading failed.
+ * */
+static StackStatus reloadTable(Stack *stack) {
+  struct node *node;
+  size_t bytes;
+
+  node = stack->spillTop;
+  bytes = node->n * stack->itemSize;
+  if (!allocItems(stack, node))
+    return STACK_NO_MEMORY;
+  // Charge the budget first, as freeItems returns the bytes on failure
+  if (stack->budget != NULL)
+    atomic_fetch_add(&stack->budget->used, bytes);
+  if (stack->compress) {
+    if (!unpackTable(stack, node, node->Items)) {
+      freeItems(stack, node);
+      return STACK_IO_ERROR;
+    }
+    free(node->packed);
+    node->packed = NULL;
+  } else {
+#ifdef __unix__
+    if (pread(fileno(stack->spillFile), node->Items, bytes,
+              (off_t)node->offset) != (ssize_t)bytes) {
+      freeItems(stack, node);
+      return STACK_IO_ERROR;
+    }
+    stack->spillBytes = node->offset;
+#ifdef POSIX_FADV_WILLNEED
+    // The next table to reload sits right before this one in the file
+    if (node->next != NULL)
+      posix_fadvise(fileno(stack->spillFile), (off_t)node->next->offset,
+                    (off_t)(node->next->n * stack->itemSize),
+                    POSIX_FADV_WILLNEED);
+#endif
+#else
+    freeItems(stack, node);
+    return STACK_IO_ERROR;
+#endif
+  }
+  stack->spillTop = node->next;
+  if (stack->scratchNode == node)
+    stack->scratchNode = NULL;
+  stack->nResident++;
+  return STACK_OK;
+}
+/* Description: Returns the items of a table for reading. Spilled tables are
+ * read or decompressed into the Stack's scratch buffer, which holds one table
+ * at a time.
+ * */
+static void *tableItems(Stack *stack, struct node *node) {
+  size_t bytes;
+  void *scratch;
+
+  if (node->Items != NULL)
+    return node->Items;
+  if (stack->scratchNode == node)
+    return stack->scratch;
+
+  bytes = node->n * stack->itemSize;
+  if (bytes > stack->scratchSize) {
+    scratch = realloc(stack->scratch, bytes);
+    if (scratch == NULL)
+      exit(0);
+    stack->scratch = scratch;
+    stack->scratchSize = bytes;
+  }
+  if (stack->compress) {
+    if (!unpackTable(stack, node, stack->scratch))
+      exit(0);
+  } else {
+#ifdef __unix__
+    if (pread(fileno(stack->spillFile), stack->scratch, bytes,
+              (off_t)node->offset) != (ssize_t)bytes)
+      exit(0);
+#endif
+  }
+  stack->scratchNode = node;
+  return stack->scratch;
+}
+/* Description: Adds delta to each of the filter counters of an item. Counters
+ * that reach the maximum stay there, since their true count is lost.
+ * */
+static void filterUpdate(Stack *stack, void *item, int delta) {
+  unsigned long long h;
+  unsigned long long h1, h2;
+  size_t j, idx;
+
+  // Mix the user hash and derive the counters by double hashing
+  h = stack->hash(item) * 0x9E3779B97F4A7C15ULL;
+  h ^= h >> 29;
+  h1 = h & 0xFFFFFFFF;
+  h2 = (h >> 32) | 1;
+  for (j = 0; j < stack->filterHashes; j++) {
+    idx = (h1 + j * h2) % stack->filterSize;
+    if (stack->filter[idx] != UCHAR_MAX)
+      stack->filter[idx] += delta;
+  }
+}
+/* Description: Returns 0 if the filter guarantees the item is not in the
+ * Stack, 1 if it may be.
+ * */
+static int filterMayContain(Stack *stack, void *item) {
+  unsigned long long h;
+  unsigned long long h1, h2;
+  size_t j;
+
+  h = stack->hash(item) * 0x9E3779B97F4A7C15ULL;
+  h ^= h >> 29;
+  h1 = h & 0xFFFFFFFF;
+  h2 = (h >> 32) | 1;
+  for (j = 0; j < stack->filterHashes; j++)
+    if (stack->filter[(h1 + j * h2) % stack->filterSize] == 0)
+      return 0;
+  return 1;
+}
+/* Description: Removes the k items at the top of the Stack from the filter.
+ * */
+static void filterRemoveTop(Stack *stack, size_t k) {
+  struct node *node_ptr;
+  size_t i;
+
+  node_ptr = stack->head;
+  i = stack->i;
+  for (; k > 0; k--) {
+    while (i == 0) {
+      node_ptr = node_ptr->next;
+      i = node_ptr->n;
+    }
+    i--;
+    filterUpdate(stack, tableItems(stack, node_ptr) + i * stack->itemSize, -1);
+  }
+}
+/* Description: Deletes the k items at the top of the Stack without copying
+ * them, releasing every table that becomes empty on the way.
+ * */
+static void truncateStack(Stack *stack, size_t k) {
+  struct node *old, *head;
+  size_t i;
+
+  if (stack->filter != NULL)
+    filterRemoveTop(stack, k);
+
+  head = stack->head;
+  i = stack->i;
+  stack->count -= k;
+  while (k > i) {
+    // Current table does not hold enough items, release it whole.
+    k -= i;
+    old = head;
+    head = head->next;
+    i = head->n;
+    releaseTable(stack, old);
+  }
+  i -= k;
+  head->prev = NULL;
+
+  stack->head = head;
+  stack->n = head->n;
+  stack->i = i;
+  if (head->Items != NULL)
+    return;
+  if (reloadTable(stack) != STACK_OK)
+    exit(0);
+}
+static Stack *newStack(size_t initial_size, size_t item_size);
 /* Description: Allocates a Stack object and initializes it with a table of the
  * specified size.
  * Arguments: The initial size of the stack in items, and the
  * size of each item in bytes.
  * Return: Pointer to the created Stack.
  * */
-Stack *initStack(unsigned int initial_size, unsigned int item_size) {
+Stack *initStack(size_t initial_size, size_t item_size) {
+  Stack *newSt;
+
+  if (tryInitStack(&newSt, initial_size, item_size) != STACK_OK)
+    exit(0);
+  return newSt;
+}
+/* Description: Same as initStack, but returns a status instead of exiting if
+ * the Stack cannot be allocated.
+ * Arguments: Pointer where the created Stack is stored, the initial size of
+ * the stack in items, and the size of each item in bytes.
+ * Return: STACK_OK, or STACK_NO_MEMORY if the allocation failed.
+ * */
+StackStatus tryInitStack(Stack **stack, size_t initial_size, size_t item_size) {
+  Stack *newSt;
+
+  newSt = newStack(initial_size, item_size);
+  if (newSt == NULL)
+    return STACK_NO_MEMORY;
+  newSt->head = allocTable(newSt, initial_size);
+  if (newSt->head == NULL) {
+    free(newSt);
+    return STACK_NO_MEMORY;
+  }
+  newSt->head->next = NULL;
+  newSt->head->prev = NULL;
+  newSt->tail = newSt->head;
+  newSt->nResident = 1;
+  *stack = newSt;
+  return STACK_OK;
+}
+/* Description: Stores the Stack's current state in its backing file's header.
+ * */
+static void writeFileHeader(Stack *stack) {
+  struct node *node_ptr;
+  uint64_t tables;
+
+  tables = 0;
+  for (node_ptr = stack->head; node_ptr != NULL; node_ptr = node_ptr->next)
+    tables++;
+  stack->fileHeader->count = stack->count;
+  stack->fileHeader->fill = stack->i;
+  stack->fileHeader->tables = tables;
+}
+#ifdef __unix__
+/* Description: Frees a Stack whose backing file failed to open, leaving the
+ * file's header untouched.
+ * Return: The status passed in.
+ * */
+static StackStatus abandonStackFile(Stack *stack, StackStatus status) {
+  if (stack->fileHeader != NULL)
+    munmap(stack->fileHeader, stack->filePage);
+  stack->fileHeader = NULL;
+  freeStack(stack);
+  return status;
+}
+#endif
+/* Description: Same as openStackFile, but returns a status instead of exiting
+ * if the file cannot be opened.
+ * Arguments: Pointer where the opened Stack is stored, then the same as
+ * openStackFile.
+ * Return: STACK_OK, STACK_IO_ERROR if the file could not be read or extended,
+ * STACK_BAD_FILE if it is not a Stack file with items of item_size bytes, or
+ * STACK_NO_MEMORY.
+ * */
+StackStatus tryOpenStackFile(Stack **stack, const char *path,
+                             size_t initial_size, size_t item_size) {
+#ifdef __unix__
+  struct fileHeader header;
+  struct node *node;
+  struct stat st;
   Stack *newSt;
+  size_t page, offset;
+  uint64_t n, total;
+  void *map;
+  int fd;
+
+  fd = open(path, O_RDWR | O_CREAT, 0644);
+  if (fd < 0)
+    return STACK_IO_ERROR;
+  if (fstat(fd, &st) != 0) {
+    close(fd);
+    return STACK_IO_ERROR;
+  }
+  page = (size_t)sysconf(_SC_PAGESIZE);
+
+  if (st.st_size == 0) {
+    // New file, write its header, the starting table is appended below
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, FILE_MAGIC, sizeof(FILE_MAGIC));
+    header.itemSize = item_size;
+    header.initialSize = initial_size;
+    header.pageSize = page;
+    if (ftruncate(fd, (off_t)page) != 0 ||
+        pwrite(fd, &header, sizeof(header), 0) != sizeof(header)) {
+      close(fd);
+      return STACK_IO_ERROR;
+    }
+    st.st_size = (off_t)page;
+  } else if (pread(fd, &header, sizeof(header), 0) != sizeof(header) ||
+             memcmp(header.magic, FILE_MAGIC, sizeof(FILE_MAGIC)) != 0 ||
+             header.itemSize != item_size || header.pageSize % page != 0) {
+    close(fd);
+    return STACK_BAD_FILE;
+  }
+
+  newSt = newStack(header.initialSize, item_size);
+  if (newSt == NULL) {
+    close(fd);
+    return STACK_NO_MEMORY;
+  }
+  newSt->fileFd = fd;
+  newSt->filePage = header.pageSize;
+  map = mmap(NULL, newSt->filePage, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (map == MAP_FAILED) {
+    freeStack(newSt);
+    return STACK_IO_ERROR;
+  }
+  newSt->fileHeader = map;
+  newSt->fileEnd = newSt->filePage;
+  newSt->fileSize = (size_t)st.st_size;
+
+  // Map the tables counted by the header in place, from the bottom of the
+  // Stack. Tables appended after the last sync are cut off below.
+  offset = newSt->filePage;
+  while (newSt->nResident < header.tables) {
+    if (pread(fd, &n, sizeof(n), (off_t)offset) != sizeof(n) ||
+        n > SIZE_MAX / 2 / (item_size + 1) ||
+        offset + fileRegion(newSt, n) > (size_t)st.st_size) {
+      return abandonStackFile(newSt, STACK_BAD_FILE);
+    }
+    node = (struct node *)malloc(sizeof(struct node));
+    if (node == NULL)
+      return abandonStackFile(newSt, STACK_NO_MEMORY);
+    node->n = n;
+    node->packed = NULL;
+    node->shared = NULL;
+    map = mmap(NULL, fileRegion(newSt, n), PROT_READ | PROT_WRITE, MAP_SHARED,
+               fd, (off_t)offset);
+    if (map == MAP_FAILED) {
+      free(node);
+      return abandonStackFile(newSt, STACK_IO_ERROR);
+    }
+    node->Items = (char *)map + FILE_TABLE_HEADER;
+    node->mapped = 2;
+    node->offset = offset;
+    node->prev = NULL;
+    node->next = newSt->head;
+    if (newSt->head != NULL)
+      newSt->head->prev = node;
+    else
+      newSt->tail = node;
+    newSt->head = node;
+    newSt->nResident++;
+    newSt->tableBytes += n * item_size;
+    offset += fileRegion(newSt, n);
+  }
+  newSt->fileEnd = offset;
+  if (newSt->fileSize > offset) {
+    if (ftruncate(fd, (off_t)offset) != 0)
+      return abandonStackFile(newSt, STACK_IO_ERROR);
+    newSt->fileSize = offset;
+  }
+
+  if (newSt->head == NULL) {
+    // New file, or one whose creation did not finish
+    newSt->head = allocTable(newSt, newSt->initialSize);
+    if (newSt->head == NULL)
+      return abandonStackFile(newSt, STACK_IO_ERROR);
+    newSt->head->next = NULL;
+    newSt->head->prev = NULL;
+    newSt->tail = newSt->head;
+    newSt->nResident = 1;
+    if (syncStack(newSt) != STACK_OK)
+      return abandonStackFile(newSt, STACK_IO_ERROR);
+    *stack = newSt;
+    return STACK_OK;
+  }
+  if (header.fill > newSt->head->n) {
+    return abandonStackFile(newSt, STACK_BAD_FILE);
+  }
+  // The tables below the top one are full, so they must add up to count
+  total = header.fill;
+  for (node = newSt->head->next; node != NULL; node = node->next) {
+    if (node->n > UINT64_MAX - total)
+      return abandonStackFile(newSt, STACK_BAD_FILE);
+    total += node->n;
+  }
+  if (total != header.count)
+    return abandonStackFile(newSt, STACK_BAD_FILE);
+  newSt->n = newSt->head->n;
+  newSt->i = header.fill;
+  newSt->count = header.count;
+  *stack = newSt;
+  return STACK_OK;
+#else
+  (void)stack;
+  (void)path;
+  (void)initial_size;
+  (void)item_size;
+  return STACK_IO_ERROR;
+#endif
+}
+/* Description: Opens a Stack whose tables live in a file, creating the file if
+ * it does not exist. The tables are mapped in place, so opening an existing
+ * file reads none of its items, and push and pop work as for any Stack. Use
+ * syncStack to make the file consistent on disk, freeStack to close it. A
+ * file left by a crash opens with the number of items of its last sync, but
+ * items are written in place, so those popped and pushed again since that
+ * sync hold their new values.
+ * Arguments:
+ *  path         - Path of the file.
+ *  initial_size - Initial size of the stack in items, if the file is created.
+ *  item_size    - Size of each item in bytes, must match an existing file.
+ * Return: Pointer to the opened Stack.
+ * */
+Stack *openStackFile(const char *path, size_t initial_size, size_t item_size) {
+  Stack *newSt;
+
+  if (tryOpenStackFile(&newSt, path, initial_size, item_size) != STACK_OK)
+    exit(0);
+  return newSt;
+}
+/* Description: Writes the Stack's state to its backing file's header and
+ * flushes the file to disk, then cuts off the tables released since the last
+ * sync. Until then the file keeps every table the header on disk counts, so
+ * that it can be reopened after a crash. Only the header is checkpointed: the
+ * items are written in place, and items changed since the sync are not
+ * restored. Does nothing for Stacks without a backing file.
+ * Return: STACK_OK, or STACK_IO_ERROR if flushing failed.
+ * */
+StackStatus syncStack(Stack *stack) {
+#ifdef __unix__
+  struct node *node_ptr;
+
+  if (stack == NULL)
+    exit(0);
+  if (stack->fileHeader == NULL)
+    return STACK_OK;
+  for (node_ptr = stack->head; node_ptr != NULL; node_ptr = node_ptr->next)
+    if (msync((char *)node_ptr->Items - FILE_TABLE_HEADER,
+              fileRegion(stack, node_ptr->n), MS_SYNC) != 0)
+      return STACK_IO_ERROR;
+  writeFileHeader(stack);
+  if (msync(stack->fileHeader, stack->filePage, MS_SYNC) != 0)
+    return STACK_IO_ERROR;
+  // Only now that the header no longer counts them are released tables cut off
+  if (stack->fileSize > stack->fileEnd) {
+    if (ftruncate(stack->fileFd, (off_t)stack->fileEnd) != 0)
+      return STACK_IO_ERROR;
+    stack->fileSize = stack->fileEnd;
+  }
+#else
+  if (stack == NULL)
+    exit(0);
+#endif
+  return STACK_OK;
+}
+/* Description: Writes the items of the Stack to a file, after a short header,
+ * with one write per table from the bottom of the Stack. The Stack is left
+ * unchanged and can be read back with loadStack.
+ * Arguments: Pointer to the Stack and the file, open for writing.
+ * Return: STACK_OK, or STACK_IO_ERROR if writing failed.
+ * */
+StackStatus saveStack(Stack *stack, FILE *file) {
+  struct saveHeader header;
+  struct node *node_ptr;
+  size_t count;
+
+  if (stack == NULL || file == NULL)
+    exit(0);
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, SAVE_MAGIC, sizeof(SAVE_MAGIC));
+  header.itemSize = stack->itemSize;
+  header.initialSize = stack->initialSize;
+  header.count = stack->count;
+  if (fwrite(&header, sizeof(header), 1, file) != 1)
+    return STACK_IO_ERROR;
+
+  // Every table below the head is full
+  for (node_ptr = stack->tail; node_ptr != NULL; node_ptr = node_ptr->prev) {
+    count = node_ptr == stack->head ? stack->i : node_ptr->n;
+    if (count > 0 && fwrite(tableItems(stack, node_ptr), stack->itemSize,
+                            count, file) != count)
+      return STACK_IO_ERROR;
+  }
+  if (fflush(file) != 0)
+    return STACK_IO_ERROR;
+  return STACK_OK;
+}
+/* Description: Creates a Stack from one written by saveStack. All of its
+ * items are read into a single table, sized to hold them.
+ * Arguments: Pointer where the created Stack is stored, and the file, open
+ * for reading at the start of the saved Stack.
+ * Return: STACK_OK, STACK_IO_ERROR if reading failed, STACK_BAD_FILE if the
+ * file does not hold a saved Stack, or STACK_NO_MEMORY.
+ * */
+StackStatus loadStack(Stack **stack, FILE *file) {
+  struct saveHeader header;
+  StackStatus status;
+  Stack *newSt;
+  size_t n;
+
+  if (file == NULL)
+    exit(0);
+  if (fread(&header, sizeof(header), 1, file) != 1)
+    return ferror(file) ? STACK_IO_ERROR : STACK_BAD_FILE;
+  if (memcmp(header.magic, SAVE_MAGIC, sizeof(SAVE_MAGIC)) != 0 ||
+      header.itemSize == 0 || header.initialSize == 0 ||
+      header.count > SIZE_MAX / header.itemSize)
+    return STACK_BAD_FILE;
+
+  newSt = newStack(header.initialSize, header.itemSize);
+  if (newSt == NULL)
+    return STACK_NO_MEMORY;
+  n = header.count > header.initialSize ? header.count : header.initialSize;
+  newSt->head = allocTable(newSt, n);
+  if (newSt->head == NULL) {
+    free(newSt);
+    return STACK_NO_MEMORY;
+  }
+  newSt->head->next = NULL;
+  newSt->head->prev = NULL;
+  newSt->tail = newSt->head;
+  newSt->nResident = 1;
+  newSt->n = n;
+  if (fread(newSt->head->Items, newSt->itemSize, header.count, file) !=
+      header.count) {
+    status = ferror(file) ? STACK_IO_ERROR : STACK_BAD_FILE;
+    freeStack(newSt);
+    return status;
+  }
+  newSt->i = header.count;
+  newSt->count = header.count;
+  *stack = newSt;
+  return STACK_OK;
+}
+/* Description: Allocates a Stack object with no tables and the settings and
+ * filter of another one, except for its budget, spilling and file.
+ * Return: Pointer to the created Stack.
+ * */
+static Stack *newStackLike(Stack *stack) {
+  Stack *newSt;
+
+  newSt = newStack(stack->initialSize, stack->itemSize);
+  if (newSt == NULL)
+    exit(0);
+  newSt->alignment = stack->alignment;
+  newSt->hugeThreshold = stack->hugeThreshold;
+  newSt->maxItems = stack->maxItems;
+  newSt->maxBytes = stack->maxBytes;
+  newSt->maxSpare = stack->maxSpare;
+  if (stack->filter != NULL) {
+    newSt->filter = malloc(stack->filterSize);
+    if (newSt->filter == NULL)
+      exit(0);
+    memcpy(newSt->filter, stack->filter, stack->filterSize);
+    newSt->filterSize = stack->filterSize;
+    newSt->filterHashes = stack->filterHashes;
+    newSt->hash = stack->hash;
+  }
+  return newSt;
+}
+/* Description: Creates a copy of the Stack that shares its tables in memory
+ * instead of copying their items. A shared table is copied only when either
+ * Stack pushes into it, so memory grows with the divergence of the two.
+ * Spilled tables and tables of a backing file are copied into memory. The
+ * copy has the Stack's settings, except for its budget, spilling and file.
+ * Arguments: Pointer to the Stack.
+ * Return: Pointer to the created Stack.
+ * */
+Stack *stackSnapshot(Stack *stack) {
+  struct node *node_ptr, *node;
+  Stack *newSt;
+  size_t count;
+
+  if (stack == NULL)
+    exit(0);
+  newSt = newStackLike(stack);
+
+  for (node_ptr = stack->head; node_ptr != NULL; node_ptr = node_ptr->next) {
+    node = (struct node *)malloc(sizeof(struct node));
+    if (node == NULL)
+      exit(0);
+    node->n = node_ptr->n;
+    node->packed = NULL;
+    node->shared = NULL;
+    if (node_ptr->Items != NULL && node_ptr->mapped != 2) {
+      if (node_ptr->shared == NULL) {
+        node_ptr->shared = malloc(sizeof(atomic_size_t));
+        if (node_ptr->shared == NULL)
+          exit(0);
+        atomic_init(node_ptr->shared, 1);
+      }
+      atomic_fetch_add(node_ptr->shared, 1);
+      node->shared = node_ptr->shared;
+      node->Items = node_ptr->Items;
+      node->mapped = node_ptr->mapped;
+      newSt->tableBytes += node->n * stack->itemSize;
+    } else {
+      if (!allocItems(newSt, node))
+        exit(0);
+      count = node_ptr == stack->head ? stack->i : node_ptr->n;
+      memcpy(node->Items, tableItems(stack, node_ptr), count * stack->itemSize);
+    }
+    node->next = NULL;
+    node->prev = newSt->tail;
+    if (newSt->tail != NULL)
+      newSt->tail->next = node;
+    else
+      newSt->head = node;
+    newSt->tail = node;
+    newSt->nResident++;
+  }
+  newSt->n = stack->n;
+  newSt->i = stack->i;
+  newSt->count = stack->count;
+  return newSt;
+}
+/* Description: Creates an independent copy of the Stack, with all of its
+ * items in a single table sized to hold them. Each table of the Stack is
+ * copied with one memcpy. The copy has the Stack's settings, except for its
+ * budget, spilling and file.
+ * Arguments: Pointer to the Stack.
+ * Return: Pointer to the created Stack.
+ * */
+Stack *cloneStack(Stack *stack) {
+  struct node *node_ptr;
+  Stack *newSt;
+  size_t n, count;
+  char *dest;
+
+  if (stack == NULL)
+    exit(0);
+  newSt = newStackLike(stack);
+  n = stack->count > stack->initialSize ? stack->count : stack->initialSize;
+  newSt->head = allocTable(newSt, n);
+  if (newSt->head == NULL)
+    exit(0);
+  newSt->head->next = NULL;
+  newSt->head->prev = NULL;
+  newSt->tail = newSt->head;
+  newSt->nResident = 1;
+
+  // Every table below the head is full
+  dest = newSt->head->Items;
+  for (node_ptr = stack->tail; node_ptr != NULL; node_ptr = node_ptr->prev) {
+    count = node_ptr == stack->head ? stack->i : node_ptr->n;
+    memcpy(dest, tableItems(stack, node_ptr), count * stack->itemSize);
+    dest += count * stack->itemSize;
+  }
+  newSt->n = n;
+  newSt->i = stack->count;
+  newSt->count = stack->count;
+  return newSt;
+}
+/* Description: Allocates a Stack object with no tables.
+ * Return: Pointer to the created Stack, NULL if the allocation failed.
+ * */
+static Stack *newStack(size_t initial_size, size_t item_size) {
+  Stack *newSt;
+
   newSt = (Stack *)malloc(sizeof(Stack));
   if (newSt == NULL)
+    return NULL;
+
+  newSt->itemSize = item_size;
+  newSt->alignment = DEFAULT_ALIGNMENT;
+  newSt->hugeThreshold = DEFAULT_HUGE_THRESHOLD;
+  newSt->tableBytes = 0;
+  newSt->maxItems = SIZE_MAX;
+  newSt->maxBytes = SIZE_MAX;
+  newSt->budget = NULL;
+  newSt->nResident = 0;
+  newSt->hotTables = 0;
+  newSt->spillFile = NULL;
+  newSt->spillBytes = 0;
+  newSt->compress = 0;
+  newSt->compactTables = 0;
+  newSt->compactStep = 0;
+  newSt->garbage = NULL;
+  newSt->freePerOp = 0;
+  newSt->spillTop = NULL;
+  newSt->scratch = NULL;
+  newSt->scratchSize = 0;
+  newSt->scratchNode = NULL;
+  newSt->fileFd = -1;
+  newSt->fileHeader = NULL;
+  newSt->filePage = 0;
+  newSt->fileEnd = 0;
+  newSt->fileSize = 0;
+  newSt->head = NULL;
+  newSt->tail = NULL;
+  newSt->spare = NULL;
+  newSt->nSpare = 0;
+  newSt->maxSpare = 0;
+  newSt->filter = NULL;
+  newSt->filterSize = 0;
+  newSt->filterHashes = 0;
+  newSt->hash = NULL;
+  newSt->n = initial_size;
+  newSt->initialSize = initial_size;
+  newSt->i = 0;
+  newSt->count = 0;
+  return newSt;
+}
+/* Description: Returns 1 if the Stack is empty, 0 otherwise.
+ * */
+int isStackEmpty(Stack *stack) {
+  return stack->i == 0 && stack->head->next == NULL;
+}
+/* Description: Returns 1 if the item already exists in the Stack, 0 otherwise.
+ * Arguments:
+ *  Stack *     - Pointer to Stack
+ *  item        - Pointer to item to search for.
+ *  max_depth   - Maximum number of items to check. -1 for no limit.
+ *  equal       - Function used to compare the items, must be 0 for different
+ *                items.
+ * */
+int itemExists(Stack *stack, void *item, long max_depth,
+               int equal(void *, void *)) {
+  struct node *node_ptr;
+  size_t i, ahead, stop;
+  void *items;
+
+  if (stack->filter != NULL && !filterMayContain(stack, item))
+    return 0;
+
+  // Each table is a separate allocation, so prefetch the next table's node
+  // when entering a table and the top of its items when about to reach it.
+  ahead = stack->itemSize != 0 ? PREFETCH_DISTANCE / stack->itemSize + 1 : 1;
+  node_ptr = stack->head;
+  i = stack->i; // i - 1 is the first occupied index
+  while (node_ptr != NULL) {
+    items = tableItems(stack, node_ptr);
+    if (node_ptr->next != NULL) {
+      PREFETCH(node_ptr->next);
+      if (i <= ahead && node_ptr->next->Items != NULL)
+        PREFETCH(node_ptr->next->Items +
+                 (node_ptr->next->n - 1) * stack->itemSize);
+    }
+    // Scan down to the last ahead items, prefetch the next table, then scan
+    // those, so that the scan itself has no prefetch check
+    stop = i > ahead ? ahead : 0;
+    for (;;) {
+      for (; i > stop; i--) {
+        if (max_depth == 0)
+          return 0;
+        if (max_depth > 0)
+          max_depth--;
+        if (equal(item, items + (i - 1) * stack->itemSize))
+          return 1;
+      }
+      if (i == 0)
+        break;
+      if (node_ptr->next != NULL && node_ptr->next->Items != NULL)
+        PREFETCH(node_ptr->next->Items +
+                 (node_ptr->next->n - 1) * stack->itemSize);
+      stop = 0;
+    }
+    // Move to next table
+    node_ptr = node_ptr->next;
+    if (node_ptr != NULL)
+      i = node_ptr->n;
+  }
+  return 0;
+}
+/* Description: Checks several items for existence in the Stack with a single
+ * traversal. Each Stack item is compared against every probe not yet found,
+ * and the traversal stops once all probes were found. Probes rejected by the
+ * Stack's filter, if any, are not compared at all.
+ * Arguments:
+ *  Stack *     - Pointer to Stack
+ *  items       - Array of count items to search for.
+ *  count       - Number of items to search for.
+ *  results     - Array of count ints, each set to 1 if the corresponding item
+ *                exists in the Stack, 0 otherwise.
+ *  max_depth   - Maximum number of Stack items to check. -1 for no limit.
+ *  equal       - Function used to compare the items, must be 0 for different
+ *                items.
+ * Return: Number of items found.
+ * */
+size_t itemExistsBatch(Stack *stack, void *items, size_t count,
+                       int *results, long max_depth,
+                       int equal(void *, void *)) {
+  struct node *node_ptr;
+  size_t j, remaining, found;
+  void *item, *table;
+  size_t i;
+
+  // Probes rejected by the filter are marked -1 until the end of the search
+  remaining = count;
+  for (j = 0; j < count; j++) {
+    results[j] = 0;
+    if (stack->filter != NULL &&
+        !filterMayContain(stack, items + j * stack->itemSize)) {
+      results[j] = -1;
+      remaining--;
+    }
+  }
+  found = 0;
+
+  node_ptr = stack->head;
+  i = stack->i; // i - 1 is the first occupied index
+  while (node_ptr != NULL && remaining > 0) {
+    table = tableItems(stack, node_ptr);
+    for (; i > 0 && max_depth != 0 && remaining > 0; i--) {
+      if (max_depth > 0)
+        max_depth--;
+      item = table + (i - 1) * stack->itemSize;
+      for (j = 0; j < count; j++) {
+        if (!results[j] && equal(items + j * stack->itemSize, item)) {
+          results[j] = 1;
+          remaining--;
+          found++;
+        }
+      }
+    }
+    if (max_depth == 0)
+      break;
+    // Move to next table
+    node_ptr = node_ptr->next;
+    if (node_ptr != NULL)
+      i = node_ptr->n;
+  }
+
+  for (j = 0; j < count; j++)
+    if (results[j] < 0)
+      results[j] = 0;
+  return found;
+}
+/* Description: Searches a range of depths from the top, recording the depth of
+ * the first match. Gives up as soon as another range found a match above the
+ * current depth, since no match of this range could then be the topmost.
+ * */
+static void *searchRange(void *arg) {
+  struct searchRange *range = arg;
+  struct parallelSearch *search = range->search;
+  size_t d, t, base, best;
+
+  t = range->table;
+  base = range->tableDepth;
+  for (d = range->lo; d < range->hi; d++) {
+    if ((d - range->lo) % 256 == 0 &&
+        atomic_load_explicit(&search->best, memory_order_relaxed) < d)
+      return NULL;
+    while (d - base == search->counts[t]) {
+      // Move to next table
+      base += search->counts[t];
+      t++;
+    }
+    if (search->equal(search->item,
+                      search->tables[t]->Items +
+                          (search->counts[t] - 1 - (d - base)) *
+                              search->itemSize)) {
+      best = atomic_load(&search->best);
+      while (d < best &&
+             !atomic_compare_exchange_weak(&search->best, &best, d))
+        ;
+      return NULL;
+    }
+  }
+  return NULL;
+}
+/* Description: Adapts an equality function for stackFind, ctx being the
+ * search with the item to compare to.
+ * */
+static int equalPred(void *ctx, void *item) {
+  struct parallelSearch *search = ctx;
+
+  return search->equal(search->item, item);
+}
+/* Description: Same as itemExists, but splits the items to check in n_threads
+ * contiguous ranges of depth searched in parallel. The topmost match is always
+ * the one reported, regardless of which thread finishes first. Stacks with
+ * spilled tables are searched by the calling thread only.
+ * Arguments:
+ *  Stack *     - Pointer to Stack
+ *  item        - Pointer to item to search for.
+ *  max_depth   - Maximum number of items to check. -1 for no limit.
+ *  equal       - Function used to compare the items, must be 0 for different
+ *                items. Called concurrently from several threads.
+ *  n_threads   - Number of threads to use, including the calling one.
+ *  depth       - If not NULL, set to the depth of the topmost match, 0 being
+ *                the top of the Stack.
+ * Return: 1 if the item exists in the Stack, 0 otherwise.
+ * */
+int itemExistsParallel(Stack *stack, void *item, long max_depth,
+                       int equal(void *, void *), size_t n_threads,
+                       size_t *depth) {
+  struct parallelSearch search;
+  struct searchRange *ranges;
+  struct node *node_ptr;
+  size_t total, chunk, n_tables, t, base, k;
+  int *started;
+
+  if (stack == NULL)
+    exit(0);
+  total = stack->count;
+  if (max_depth >= 0 && (unsigned long)max_depth < total)
+    total = max_depth;
+  if (n_threads == 0)
+    n_threads = 1;
+  if (n_threads > total)
+    n_threads = total;
+  if (n_threads == 0)
+    return 0;
+  if (stack->filter != NULL && !filterMayContain(stack, item))
+    return 0;
+  if (stack->spillTop != NULL) {
+    // Spilled tables are read into a single buffer, search them serially
+    search.item = item;
+    search.equal = equal;
+    return stackFind(stack, &search, equalPred, max_depth, depth) != NULL;
+  }
+
+  n_tables = 0;
+  for (node_ptr = stack->head; node_ptr != NULL; node_ptr = node_ptr->next)
+    n_tables++;
+  search.tables = malloc(n_tables * sizeof(struct node *));
+  search.counts = malloc(n_tables * sizeof(size_t));
+  ranges = malloc(n_threads * sizeof(struct searchRange));
+  started = malloc(n_threads * sizeof(int));
+  if (search.tables == NULL || search.counts == NULL || ranges == NULL ||
+      started == NULL)
+    exit(0);
+  t = 0;
+  for (node_ptr = stack->head; node_ptr != NULL; node_ptr = node_ptr->next) {
+    search.tables[t] = node_ptr;
+    search.counts[t] = node_ptr == stack->head ? stack->i : node_ptr->n;
+    t++;
+  }
+  search.itemSize = stack->itemSize;
+  search.item = item;
+  search.equal = equal;
+  atomic_init(&search.best, SIZE_MAX);
+
+  // Split the depths in ranges, locating the table of each range's start
+  chunk = total / n_threads + (total % n_threads != 0);
+  t = 0;
+  base = 0;
+  for (k = 0; k < n_threads; k++) {
+    ranges[k].search = &search;
+    ranges[k].lo = k * chunk < total ? k * chunk : total;
+    ranges[k].hi = ranges[k].lo + chunk < total ? ranges[k].lo + chunk : total;
+    while (ranges[k].lo < total && ranges[k].lo - base >= search.counts[t]) {
+      base += search.counts[t];
+      t++;
+    }
+    ranges[k].table = t;
+    ranges[k].tableDepth = base;
+  }
+
+  // The calling thread searches the topmost range itself
+  for (k = 1; k < n_threads; k++)
+    started[k] = pthread_create(&ranges[k].thread, NULL, searchRange,
+                                &ranges[k]) == 0;
+  searchRange(&ranges[0]);
+  for (k = 1; k < n_threads; k++) {
+    if (started[k])
+      pthread_join(ranges[k].thread, NULL);
+    else
+      searchRange(&ranges[k]);
+  }
+
+  free(started);
+  free(ranges);
+  free(search.counts);
+  free(search.tables);
+  if (search.best == SIZE_MAX)
+    return 0;
+  if (depth != NULL)
+    *depth = search.best;
+  return 1;
+}
+/* Description: Searches the Stack from the top for the first item satisfying
+ * pred.
+ * Arguments:
+ *  Stack *     - Pointer to Stack
+ *  ctx         - Pointer passed untouched to pred.
+ *  pred        - Function called with ctx and an item, must be 0 for items
+ *                that do not match.
+ *  max_depth   - Maximum number of items to check. -1 for no limit.
+ *  depth       - If not NULL, set to the depth of the item found, 0 being the
+ *                top of the Stack.
+ * Return: Pointer to the item found inside the Stack, NULL if none matched.
+ * The pointer is valid until the Stack is modified or, if the item's table is
+ * spilled, searched again.
+ * */
+void *stackFind(Stack *stack, void *ctx, int pred(void *ctx, void *item),
+                long max_depth, size_t *depth) {
+  struct node *node_ptr;
+  size_t d, i;
+  void *items;
+
+  node_ptr = stack->head;
+  d = 0;
+  i = stack->i; // i - 1 is the first occupied index
+  while (node_ptr != NULL) {
+    items = tableItems(stack, node_ptr);
+    for (; i > 0; i--, d++) {
+      if (max_depth == 0)
+        return NULL;
+      if (max_depth > 0)
+        max_depth--;
+      if (pred(ctx, items + (i - 1) * stack->itemSize)) {
+        if (depth != NULL)
+          *depth = d;
+        return items + (i - 1) * stack->itemSize;
+      }
+    }
+    // Move to next table
+    node_ptr = node_ptr->next;
+    if (node_ptr != NULL)
+      i = node_ptr->n;
+  }
+  return NULL;
+}
+/* Description: Searches the Stack from the top for every item satisfying pred
+ * and stores their depths, 0 being the top of the Stack.
+ * Arguments:
+ *  Stack *     - Pointer to Stack
+ *  ctx         - Pointer passed untouched to pred.
+ *  pred        - Function called with ctx and an item, must be 0 for items
+ *                that do not match.
+ *  max_depth   - Maximum number of items to check. -1 for no limit.
+ *  depths      - Array where the depths of the matching items are stored.
+ *  max_results - Size of depths, the search stops once it is full.
+ * Return: Number of depths stored.
+ * */
+size_t stackFindAll(Stack *stack, void *ctx, int pred(void *ctx, void *item),
+                    long max_depth, size_t *depths, size_t max_results) {
+  struct node *node_ptr;
+  size_t d, found, i;
+  void *items;
+
+  node_ptr = stack->head;
+  d = 0;
+  found = 0;
+  i = stack->i; // i - 1 is the first occupied index
+  while (node_ptr != NULL) {
+    items = tableItems(stack, node_ptr);
+    for (; i > 0; i--, d++) {
+      if (max_depth == 0 || found == max_results)
+        return found;
+      if (max_depth > 0)
+        max_depth--;
+      if (pred(ctx, items + (i - 1) * stack->itemSize))
+        depths[found++] = d;
+    }
+    // Move to next table
+    node_ptr = node_ptr->next;
+    if (node_ptr != NULL)
+      i = node_ptr->n;
+  }
+  return found;
+}
+/* Description: Frees a Stack object and its contents, see freeStack.
+ * */
+static void freeStackNow(Stack *stack) {
+  struct node *old;
+
+  reclaimTables(stack, SIZE_MAX);
+  if (stack->fileHeader != NULL)
+    writeFileHeader(stack);
+  while (stack->head != NULL) {
+    old = stack->head;
+    stack->head = stack->head->next;
+    freeTable(stack, old);
+  }
+  while (stack->spare != NULL) {
+    old = stack->spare;
+    stack->spare = stack->spare->next;
+    freeTable(stack, old);
+  }
+  if (stack->spillFile != NULL)
+    fclose(stack->spillFile);
+#ifdef __unix__
+  if (stack->fileHeader != NULL)
+    munmap(stack->fileHeader, stack->filePage);
+  if (stack->fileFd >= 0)
+    close(stack->fileFd);
+#endif
+  free(stack->scratch);
+  free(stack->filter);
+  free(stack);
+}
+/* Description: Thread freeing a Stack handed over by freeStack.
+ * */
+static void *freeStackThread(void *stack) {
+  freeStackNow(stack);
+  return NULL;
+}
+/* Description: Frees a Stack object and its contents. If the Stack defers
+ * freeing its tables, see setStackDeferredFree, they are freed on a detached
+ * thread and freeStack returns at once. Their bytes are returned to the
+ * Stack's budget before that, so the budget can be freed right after.
+ * */
+void freeStack(Stack *stack) {
+  pthread_t thread;
+
+  if (stack == NULL)
+    exit(0);
+  if (stack->freePerOp != 0) {
+    // tableBytes also counts the tables in the garbage list
+    if (stack->budget != NULL)
+      atomic_fetch_sub(&stack->budget->used, stack->tableBytes);
+    stack->budget = NULL;
+  }
+  if (stack->freePerOp != 0 &&
+      pthread_create(&thread, NULL, freeStackThread, stack) == 0) {
+    pthread_detach(thread);
+    return;
+  }
+  freeStackNow(stack);
+}
+/* Description: Deletes every item in the Stack without copying them. Every
+ * table except the starting one is freed, or kept as spare capacity if the
+ * Stack was configured to do so with setStackSpareTables.
+ * */
+void clearStack(Stack *stack) {
+  struct node *old;
+
+  if (stack == NULL)
+    exit(0);
+  if (stack->filter != NULL)
+    memset(stack->filter, 0, stack->filterSize);
+  if (stack->freePerOp != 0 && stack->head != stack->tail) {
+    // Hand every table but the starting one over to be freed later, at once
+    old = stack->tail->prev;
+    old->next = stack->garbage;
+    stack->garbage = stack->head;
+    stack->head = stack->tail;
+    stack->nResident = stack->tail->Items != NULL;
+    stack->scratchNode = NULL;
+  }
+  while (stack->head->next != NULL) {
+    old = stack->head;
+    stack->head = stack->head->next;
+    releaseTable(stack, old);
+  }
+  stack->head->prev = NULL;
+  if (stack->head->Items == NULL) {
+    // The starting table was spilled, its contents are not needed anymore
+    if (!allocItems(stack, stack->head))
+      exit(0);
+    if (stack->budget != NULL)
+      atomic_fetch_add(&stack->budget->used,
+                       stack->head->n * stack->itemSize);
+    free(stack->head->packed);
+    stack->head->packed = NULL;
+    stack->spillTop = NULL;
+    stack->spillBytes = 0;
+    stack->scratchNode = NULL;
+    stack->nResident++;
+  }
+  stack->n = stack->head->n;
+  stack->i = 0;
+  stack->count = 0;
+}
+/* Description: Sets the maximum number of emptied tables the Stack keeps
+ * allocated for reuse by later pushes, instead of freeing them. Spare tables
+ * beyond the new maximum are freed. The default is 0.
+ * Arguments: Pointer to the Stack and the maximum number of spare tables.
+ * */
+void setStackSpareTables(Stack *stack, size_t max_tables) {
+  struct node *old;
+
+  if (stack == NULL)
+    exit(0);
+  stack->maxSpare = max_tables;
+  while (stack->nSpare > max_tables) {
+    old = stack->spare;
+    stack->spare = old->next;
+    stack->nSpare--;
+    freeTable(stack, old);
+  }
+}
+/* Description: Sets the alignment of the tables allocated from now on, and the
+ * table size from which they are mapped directly from the system, backed by
+ * huge pages where supported, instead of coming from malloc. The defaults are
+ * 64 bytes and 64 MiB.
+ * Arguments:
+ *  Stack *        - Pointer to Stack
+ *  alignment      - Alignment in bytes, a power of two multiple of
+ *                   sizeof(void *).
+ *  huge_threshold - Table size in bytes from which tables are mapped, 0 to
+ *                   never map them.
+ * */
+void setStackAlignment(Stack *stack, size_t alignment, size_t huge_threshold) {
+  if (stack == NULL || alignment < sizeof(void *) ||
+      (alignment & (alignment - 1)) != 0)
+    exit(0);
+  stack->alignment = alignment;
+  stack->hugeThreshold = huge_threshold;
+}
+/* Description: Limits the number of items of the Stack and the bytes of its
+ * tables, spare ones included. Once a limit is reached tryPush returns
+ * STACK_FULL. Lowering a limit below the current use frees nothing.
+ * Arguments:
+ *  Stack *   - Pointer to Stack
+ *  max_items - Maximum number of items, 0 for no limit.
+ *  max_bytes - Maximum bytes of the tables, 0 for no limit.
+ * */
+void setStackLimit(Stack *stack, size_t max_items, size_t max_bytes) {
+  if (stack == NULL)
+    exit(0);
+  stack->maxItems = max_items != 0 ? max_items : SIZE_MAX;
+  stack->maxBytes = max_bytes != 0 ? max_bytes : SIZE_MAX;
+}
+/* Description: Allocates a byte budget that can be shared by several Stacks,
+ * possibly used from different threads, see setStackBudget.
+ * Arguments: Maximum bytes of the tables of all Stacks using the budget.
+ * Return: Pointer to the created budget.
+ * */
+StackBudget *initStackBudget(size_t max_bytes) {
+  StackBudget *budget;
+
+  budget = (StackBudget *)malloc(sizeof(StackBudget));
+  if (budget == NULL)
+    exit(0);
+  atomic_init(&budget->used, 0);
+  budget->maxBytes = max_bytes;
+  return budget;
+}
+/* Description: Frees a budget. No Stack may be using it anymore.
+ * */
+void freeStackBudget(StackBudget *budget) { free(budget); }
+/* Description: Returns the bytes currently charged to a budget.
+ * */
+size_t stackBudgetUsed(StackBudget *budget) {
+  return atomic_load(&budget->used);
+}
+/* Description: Makes the Stack's tables count against a budget. The tables the
+ * Stack already has are charged at once, even if that exceeds the budget, and
+ * new tables that would exceed it make tryPush return STACK_FULL.
+ * Arguments: Pointer to the Stack and pointer to the budget, NULL to stop
+ * using one.
+ * */
+void setStackBudget(Stack *stack, StackBudget *budget) {
+  if (stack == NULL)
+    exit(0);
+  if (stack->budget != NULL)
+    atomic_fetch_sub(&stack->budget->used, stack->tableBytes);
+  stack->budget = budget;
+  if (budget != NULL)
+    atomic_fetch_add(&budget->used, stack->tableBytes);
+}
+/* Description: Keeps only the hot_tables topmost tables in memory, writing
+ * colder tables to a temporary file as new tables are pushed, and reading them
+ * back when pop reaches them. Searches read spilled tables from the file.
+ * Arguments: Pointer to the Stack and the number of tables kept in memory, 0
+ * to read every spilled table back and stop spilling.
+ * Return: STACK_OK, or STACK_IO_ERROR, STACK_NO_MEMORY if the file could not
+ * be created or the tables read back. Stacks with a backing file cannot spill.
+ * */
+StackStatus setStackSpill(Stack *stack, size_t hot_tables) {
+  StackStatus status;
+
+  if (stack == NULL)
     exit(0);
+#ifndef __unix__
+  if (hot_tables != 0)
+    return STACK_IO_ERROR;
+#endif
+  if (hot_tables != 0 && stack->fileFd >= 0)
+    return STACK_IO_ERROR;
+  if (stack->compress) {
+    // Decompress the cold tables before spilling them instead
+    status = setStackCompress(stack, 0);
+    if (status != STACK_OK)
+      return status;
+  }
+  if (hot_tables != 0 && stack->spillFile == NULL) {
+    stack->spillFile = tmpfile();
+    if (stack->spillFile == NULL)
+      return STACK_IO_ERROR;
+  }
+  stack->hotTables = hot_tables;
+  if (hot_tables != 0) {
+    while (stack->nResident > hot_tables && spillTable(stack))
+      ;
+    return STACK_OK;
+  }
 
-  newSt->head = (struct node *)malloc(sizeof(struct node));
-  if (newSt->head == NULL)
+  while (stack->spillTop != NULL) {
+    status = reloadTable(stack);
+    if (status != STACK_OK)
+      return status;
+  }
+  if (stack->spillFile != NULL)
+    fclose(stack->spillFile);
+  stack->spillFile = NULL;
+  return STACK_OK;
+}
+/* Description: Same as setStackSpill, but compresses the cold tables in
+ * memory instead of writing them to a file. Pop decompresses them back when it
+ * reaches them, and searches decompress them into a scratch buffer. Enabling
+ * one of the two modes first reads back the tables spilled by the other.
+ * Arguments: Pointer to the Stack and the number of tables kept uncompressed,
+ * 0 to decompress every table and stop compressing.
+ * Return: STACK_OK, STACK_NO_MEMORY if the tables could not be read back, or
+ * STACK_IO_ERROR for Stacks with a backing file.
+ * */
+StackStatus setStackCompress(Stack *stack, size_t hot_tables) {
+  StackStatus status;
+
+  if (stack == NULL)
     exit(0);
+  if (hot_tables != 0 && stack->fileFd >= 0)
+    return STACK_IO_ERROR;
+  if (!stack->compress) {
+    status = setStackSpill(stack, 0);
+    if (status != STACK_OK)
+      return status;
+    stack->compress = 1;
+  }
+  stack->hotTables = hot_tables;
+  if (hot_tables != 0) {
+    while (stack->nResident > hot_tables && spillTable(stack))
+      ;
+    return STACK_OK;
+  }
+
+  while (stack->spillTop != NULL) {
+    status = reloadTable(stack);
+    if (status != STACK_OK)
+      return status;
+  }
+  stack->compress = 0;
+  return STACK_OK;
+}
+/* Description: Merges adjacent tables in memory into one contiguous table, so
+ * that searches and iterations cross fewer tables. Each call merges at most
+ * max_tables tables, choosing the adjacent ones with the fewest bytes, so the
+ * time taken is bounded and repeated calls even out the tables' sizes. Stacks
+ * with a backing file are left unchanged.
+ * Arguments: Pointer to the Stack and the maximum number of tables to merge, 0
+ * to merge every table in memory.
+ * Return: STACK_OK, STACK_FULL if the Stack's limits or budget do not allow a
+ * copy of the merged tables, or STACK_NO_MEMORY.
+ * */
+StackStatus compactStack(Stack *stack, size_t max_tables) {
+  struct node *first, *last, *best, *merged, *node_ptr, *old;
+  size_t tables, size, bestSize, bytes, count;
+  char *dest;
 
-  newSt->head->Items = malloc(initial_size * item_size);
-  if (newSt->head->Items == NULL)
+  if (stack == NULL)
     exit(0);
+  if (stack->fileFd >= 0 || stack->nResident < 2)
+    return STACK_OK;
+  if (max_tables == 0 || max_tables > stack->nResident)
+    max_tables = stack->nResident;
+  if (max_tables < 2)
+    return STACK_OK;
 
-  newSt->head->next = NULL;
-  newSt->n = initial_size;
-  newSt->initialSize = initial_size;
-  newSt->itemSize = item_size;
-  newSt->i = 0;
-  return newSt;
-};
-/* Description: Returns 1 if the Stack is empty, 0 otherwise.
+  // Slide a window of max_tables tables down the tables in memory
+  first = stack->head;
+  last = stack->head;
+  size = last->n;
+  for (tables = 1; tables < max_tables; tables++) {
+    last = last->next;
+    size += last->n;
+  }
+  best = first;
+  bestSize = size;
+  while (last->next != NULL && last->next->Items != NULL) {
+    size -= first->n;
+    first = first->next;
+    last = last->next;
+    size += last->n;
+    if (size <= bestSize) {
+      best = first;
+      bestSize = size;
+    }
+  }
+  first = best;
+  last = first;
+  for (tables = 1; tables < max_tables; tables++)
+    last = last->next;
+
+  // The tables already hold bestSize items, so its bytes cannot overflow
+  bytes = bestSize * stack->itemSize;
+  if (stack->tableBytes > stack->maxBytes ||
+      bytes > stack->maxBytes - stack->tableBytes ||
+      (stack->budget != NULL && !budgetCharge(stack->budget, bytes)))
+    return STACK_FULL;
+  merged = allocTable(stack, bestSize);
+  if (merged == NULL) {
+    if (stack->budget != NULL)
+      atomic_fetch_sub(&stack->budget->used, bytes);
+    return STACK_NO_MEMORY;
+  }
+
+  // Copy from the bottom up, every table but the head is full
+  dest = merged->Items;
+  for (node_ptr = last;; node_ptr = node_ptr->prev) {
+    count = node_ptr == stack->head ? stack->i : node_ptr->n;
+    memcpy(dest, node_ptr->Items, count * stack->itemSize);
+    dest += count * stack->itemSize;
+    if (node_ptr == first)
+      break;
+  }
+
+  merged->prev = first->prev;
+  merged->next = last->next;
+  if (first->prev != NULL)
+    first->prev->next = merged;
+  if (last->next != NULL)
+    last->next->prev = merged;
+  else
+    stack->tail = merged;
+  if (first == stack->head) {
+    stack->head = merged;
+    stack->i += bestSize - first->n;
+    stack->n = merged->n;
+  }
+  node_ptr = first;
+  for (tables = 0; tables < max_tables; tables++) {
+    old = node_ptr;
+    node_ptr = node_ptr->next;
+    freeTable(stack, old);
+  }
+  stack->nResident -= max_tables - 1;
+  return STACK_OK;
+}
+/* Description: Compacts the Stack automatically: once it holds more than
+ * max_tables tables in memory, each push that adds a table also merges
+ * merge_tables of them, see compactStack.
+ * Arguments: Pointer to the Stack, the number of tables in memory from which
+ * to compact, 0 to never compact automatically, and the number of tables
+ * merged each time, 0 to merge them all.
  * */
-int isStackEmpty(Stack *stack) {
-  return stack->i == 0 && stack->head->next == NULL;
+void setStackAutoCompact(Stack *stack, size_t max_tables, size_t merge_tables) {
+  if (stack == NULL)
+    exit(0);
+  stack->compactTables = max_tables;
+  stack->compactStep = merge_tables;
 }
-/* Description: Returns 1 if the item already exists in the Stack, 0 otherwise.
+/* Description: Defers freeing the tables the Stack releases, so that releasing
+ * many tables does not stall the caller. clearStack hands its tables over at
+ * once, and each later push or pop frees at most tables_per_op of them.
+ * freeStack frees the whole Stack on a detached thread. Stacks with a backing
+ * file always free their tables at once.
+ * Arguments: Pointer to the Stack and the number of tables freed by each push
+ * or pop, 0 to free tables at once again, including the deferred ones.
+ * */
+void setStackDeferredFree(Stack *stack, size_t tables_per_op) {
+  if (stack == NULL)
+    exit(0);
+  if (stack->fileFd >= 0)
+    return;
+  stack->freePerOp = tables_per_op;
+  if (tables_per_op == 0)
+    reclaimTables(stack, SIZE_MAX);
+}
+/* Description: Enables a counting Bloom filter of the Stack's items, consulted
+ * by the searches before scanning the tables, so that most searches for items
+ * not in the Stack return immediately. The filter is kept by push and pop;
+ * drop, dropN and stackRollback then have to read the items they delete.
  * Arguments:
- *  Stack *     - Pointer to Stack
- *  item        - Pointer to item to search for.
- *  max_depth   - Maximum number of items to check. -1 for no limit.
- *  equal       - Function used to compare the items, must be 0 for different
- *                items.
+ *  Stack *        - Pointer to Stack
+ *  expected_items - Number of items the filter is sized for.
+ *  fp_rate        - Wanted false positive rate with expected_items items,
+ *                   between 0 and 1.
+ *  hash           - Hash function of the items, must return the same value
+ *                   for items that are equal for the searches. NULL disables
+ *                   the filter.
  * */
-int itemExists(Stack *stack, void *item, int max_depth,
-               int equal(void *, void *)) {
+void setStackFilter(Stack *stack, size_t expected_items, double fp_rate,
+                    unsigned long hash(void *)) {
   struct node *node_ptr;
-  int i, n;
+  double m, ln2;
+  size_t i;
+  void *items;
+
+  if (stack == NULL || (hash != NULL && (fp_rate <= 0 || fp_rate >= 1)))
+    exit(0);
+  free(stack->filter);
+  stack->filter = NULL;
+  stack->filterSize = 0;
+  stack->filterHashes = 0;
+  stack->hash = hash;
+  if (hash == NULL)
+    return;
 
+  // Optimal number of counters and hashes for the wanted rate
+  if (expected_items == 0)
+    expected_items = 1;
+  ln2 = log(2.0);
+  m = ceil(-(double)expected_items * log(fp_rate) / (ln2 * ln2));
+  if (m > (double)(SIZE_MAX / 2))
+    m = (double)(SIZE_MAX / 2);
+  stack->filterSize = (size_t)m;
+  stack->filterHashes = (size_t)round(m / expected_items * ln2);
+  if (stack->filterHashes == 0)
+    stack->filterHashes = 1;
+  stack->filter = calloc(stack->filterSize, 1);
+  if (stack->filter == NULL)
+    exit(0);
+
+  // Add the items already in the Stack
   node_ptr = stack->head;
-  n = stack->n;
-  i = stack->i - 1; // i - 1 is the first occupied index
+  i = stack->i;
   while (node_ptr != NULL) {
-    for (; i >= 0; i--) {
-      if (max_depth == 0)
-        return 0;
-      if (max_depth > 0)
-        max_depth--;
-      if (equal(item, node_ptr->Items + i * stack->itemSize))
-        return 1;
-    }
-    // Move to next table
+    items = tableItems(stack, node_ptr);
+    for (; i > 0; i--)
+      filterUpdate(stack, items + (i - 1) * stack->itemSize, 1);
     node_ptr = node_ptr->next;
-    n = n - stack->initialSize;
-    i = n - 1;
+    if (node_ptr != NULL)
+      i = node_ptr->n;
   }
-  return 0;
 }
-/* Description: Frees a Stack object and its contents.
+/* Description: Fills stats with the Stack's current item count and memory use.
+ * Arguments: Pointer to the Stack and pointer to the statistics to fill.
  * */
-void freeStack(Stack *stack) {
-  struct node *old;
+void getStackStats(Stack *stack, StackStats *stats) {
+  struct node *node_ptr;
 
-  if (stack == NULL)
+  if (stack == NULL || stats == NULL)
     exit(0);
-  while (stack->head != NULL) {
-    old = stack->head;
-    stack->head = stack->head->next;
-    free(old->Items);
-    free(old);
+  stats->items = stack->count;
+  stats->tables = 0;
+  stats->tableBytes = 0;
+  stats->spilledTables = 0;
+  stats->spilledBytes = stack->spillBytes;
+  stats->compressedTables = 0;
+  stats->compressedBytes = 0;
+  stats->savedBytes = 0;
+  for (node_ptr = stack->head; node_ptr != NULL; node_ptr = node_ptr->next) {
+    stats->tables++;
+    if (node_ptr->Items != NULL) {
+      stats->tableBytes += node_ptr->n * stack->itemSize;
+    } else if (node_ptr->packed != NULL) {
+      stats->compressedTables++;
+      stats->compressedBytes += node_ptr->packedSize;
+      stats->savedBytes += node_ptr->n * stack->itemSize - node_ptr->packedSize;
+    } else {
+      stats->spilledTables++;
+    }
   }
-  free(stack);
+  stats->spareTables = stack->nSpare;
+  stats->spareBytes = 0;
+  for (node_ptr = stack->spare; node_ptr != NULL; node_ptr = node_ptr->next)
+    stats->spareBytes += node_ptr->n * stack->itemSize;
+  stats->filterBytes = stack->filterSize;
 }
 /* Description: Copies an item to the top of the Stack. If the current table is
  * full, allocates one more with a linearly increasing size.
  * Arguments: Pointer to the Stack and pointer to the item to be copied.
  * */
 void push(Stack *stack, void *item) {
+  if (tryPush(stack, item) != STACK_OK)
+    exit(0);
+}
+/* Description: Same as push, but returns a status instead of exiting if the
+ * item cannot be pushed. The Stack is unchanged in that case.
+ * Arguments: Pointer to the Stack and pointer to the item to be copied.
+ * Return: STACK_OK, STACK_FULL if the Stack's limits or budget would be
+ * exceeded, STACK_NO_MEMORY if a new table could not be allocated, or
+ * STACK_OVERFLOW if the new table's size does not fit in a size_t.
+ * */
+StackStatus tryPush(Stack *stack, void *item) {
   struct node *head, *new_node;
-  unsigned int i, n, itemSize;
+  size_t i, n, itemSize;
+  StackStatus status;
 
   if (stack == NULL)
     exit(0);
+  if (stack->garbage != NULL)
+    reclaimTables(stack, stack->freePerOp);
+  if (stack->count == stack->maxItems)
+    return STACK_FULL;
 
   // Using local variables for readability only, let the compiler micromanage
   head = stack->head;
@@ -145,41 +2230,70 @@ void push(Stack *stack, void *item) {
     n = n + stack->initialSize;
     // Check for overflow, since i == old n :
     if (i >= n)
-      exit(0);
+      return STACK_OVERFLOW;
 
-    new_node = (struct node *)malloc(sizeof(struct node));
+    new_node = newTable(stack, n, &status);
     if (new_node == NULL)
-      exit(0);
-
-    new_node->Items = malloc(n * itemSize);
-    if (new_node->Items == NULL)
-      exit(0);
-
+      return status;
+    n = new_node->n;
     new_node->next = head;
+    new_node->prev = NULL;
+    head->prev = new_node;
     head = new_node;
     i = 0;
     // Update values since using local variables
     stack->head = head;
     stack->n = n;
+    stack->nResident++;
+    if (stack->hotTables != 0 && stack->nResident > stack->hotTables)
+      spillTable(stack);
+    if (stack->compactTables != 0 && stack->nResident > stack->compactTables) {
+      stack->i = i;
+      compactStack(stack, stack->compactStep);
+      head = stack->head;
+      n = stack->n;
+      i = stack->i;
+    }
   }
 
+  if (head->shared != NULL && !unshareTable(stack, head))
+    return STACK_NO_MEMORY;
   memcpy(head->Items + i * itemSize, item, itemSize);
   i++;
+  if (stack->filter != NULL)
+    filterUpdate(stack, item, 1);
 
   stack->i = i;
+  stack->count++;
+  return STACK_OK;
 }
 /* Description: Copies an item from the top of the Stack and deletes it from the
- * Stack. Only frees a table if a pop is called while it is empty. As a
+ * Stack. Only releases a table if a pop is called while it is empty. As a
  * consequence, the Stack always keeps at least the starting table in memory,
  * until it is freed.
  * Arguments: Pointer to the Stack and pointer with the destination address.
  * */
 void pop(Stack *stack, void *dest) {
+  if (tryPop(stack, dest) != STACK_OK)
+    exit(0);
+}
+/* Description: Same as pop, but returns STACK_EMPTY instead of exiting if the
+ * Stack is empty, so that no separate isStackEmpty check is needed.
+ * Arguments: Pointer to the Stack and pointer with the destination address.
+ * Return: STACK_OK, STACK_EMPTY if the Stack was empty, or STACK_NO_MEMORY or
+ * STACK_IO_ERROR if a spilled table could not be read back.
+ * */
+StackStatus tryPop(Stack *stack, void *dest) {
   struct node *old, *head;
-  unsigned int i, n, itemSize;
+  size_t i, n, itemSize;
+  StackStatus status;
 
-  if (stack == NULL || isStackEmpty(stack))
+  if (stack == NULL)
     exit(0);
+  if (stack->garbage != NULL)
+    reclaimTables(stack, stack->freePerOp);
+  if (stack->count == 0)
+    return STACK_EMPTY;
 
   // Using local variables for readability only, let the compiler micromanage
   head = stack->head;
@@ -189,14 +2303,19 @@ void pop(Stack *stack, void *dest) {
 
   if (i == 0) {
     // Current table is empty, free it.
-    n = n - stack->initialSize;
-    i = n;
+    if (head->next->Items == NULL) {
+      status = reloadTable(stack);
+      if (status != STACK_OK)
+        return status;
+    }
     old = head;
     // Since Stack is not empty, if current table is empty then head->next is
     // the next table and is full
     head = head->next;
-    free(old->Items);
-    free(old);
+    head->prev = NULL;
+    n = head->n;
+    i = n;
+    releaseTable(stack, old);
 
     // Update values since using local variables
     stack->head = head;
@@ -205,6 +2324,704 @@ void pop(Stack *stack, void *dest) {
 
   i--;
   memcpy(dest, head->Items + i * itemSize, itemSize);
+  if (stack->filter != NULL)
+    filterUpdate(stack, dest, -1);
 
   stack->i = i;
+  stack->count--;
+  return STACK_OK;
+}
+/* Description: Deletes the item at the top of the Stack without copying it.
+ * */
+void drop(Stack *stack) {
+  if (stack == NULL || isStackEmpty(stack))
+    exit(0);
+  truncateStack(stack, 1);
+}
+/* Description: Deletes the k items at the top of the Stack without copying
+ * them. Emptied tables are freed or kept as spare capacity, see
+ * setStackSpareTables. Takes time proportional to the number of tables
+ * crossed, not to k.
+ * Arguments: Pointer to the Stack and the number of items to delete, which
+ * must not exceed the number of items in the Stack.
+ * */
+void dropN(Stack *stack, size_t k) {
+  if (stack == NULL || k > stack->count)
+    exit(0);
+  truncateStack(stack, k);
+}
+/* Description: Returns a checkpoint of the current state of the Stack, to be
+ * later restored with stackRollback.
+ * */
+StackMark stackMark(Stack *stack) {
+  if (stack == NULL)
+    exit(0);
+  return stack->count;
+}
+/* Description: Deletes every item pushed since the checkpoint was taken,
+ * without copying them. Emptied tables are freed or kept as spare capacity,
+ * see setStackSpareTables. Takes time proportional to the number of tables
+ * crossed, not to the number of items deleted.
+ * Arguments: Pointer to the Stack and a checkpoint returned by stackMark. The
+ * Stack must not have been popped below the checkpoint.
+ * */
+void stackRollback(Stack *stack, StackMark mark) {
+  if (stack == NULL || mark > stack->count)
+    exit(0);
+  truncateStack(stack, stack->count - mark);
+}
+/* Description: Moves every item of src on top of dst, leaving src empty. The
+ * tables of src are relinked onto dst instead of copied, only the items of
+ * dst's partially filled top table are, so the time taken is proportional to
+ * the tables moved. If dst has a filter, the moved items are added to it.
+ * Stacks with a backing file, or a src with spilled tables, are copied item
+ * by item instead.
+ * Arguments: Pointer to the destination Stack and pointer to the source Stack,
+ * with items of the same size.
+ * Return: STACK_OK, STACK_FULL if dst's limits or budget would be exceeded,
+ * or STACK_NO_MEMORY. On failure src is unchanged, though dst may hold part
+ * of its items if they were copied.
+ * */
+StackStatus stackSplice(Stack *dst, Stack *src) {
+  struct node *node_ptr, *top, *fresh, *part;
+  size_t bytes, partBytes, count, j;
+  StackStatus status;
+  StackIterator it;
+  int partCharged;
+  void *item;
+
+  if (dst == NULL || src == NULL || dst == src ||
+      dst->itemSize != src->itemSize)
+    exit(0);
+  if (src->count == 0)
+    return STACK_OK;
+  if (dst->count > dst->maxItems || src->count > dst->maxItems - dst->count)
+    return STACK_FULL;
+  if (src->spillTop != NULL || src->fileFd >= 0 || dst->fileFd >= 0) {
+    // These tables cannot change Stack, copy the items instead
+    stackIterBottom(src, &it);
+    while ((item = stackIterNext(&it)) != NULL) {
+      status = tryPush(dst, item);
+      if (status != STACK_OK)
+        return status;
+    }
+    clearStack(src);
+    return STACK_OK;
+  }
+
+  bytes = 0;
+  for (node_ptr = src->head; node_ptr != NULL; node_ptr = node_ptr->next)
+    bytes += node_ptr->n * src->itemSize;
+  // Tables below the top must be full, so dst's top one is cut to its items
+  partBytes = dst->i != dst->n ? dst->i * dst->itemSize : 0;
+  if (dst->tableBytes > dst->maxBytes ||
+      bytes > dst->maxBytes - dst->tableBytes ||
+      partBytes > dst->maxBytes - dst->tableBytes - bytes)
+    return STACK_FULL;
+  if (dst->budget != src->budget) {
+    if (dst->budget != NULL && !budgetCharge(dst->budget, bytes))
+      return STACK_FULL;
+    if (src->budget != NULL)
+      atomic_fetch_sub(&src->budget->used, bytes);
+  }
+  part = NULL;
+  partCharged = 0;
+  fresh = NULL;
+  status = STACK_OK;
+  if (partBytes != 0) {
+    if (dst->budget != NULL && !budgetCharge(dst->budget, partBytes))
+      status = STACK_FULL;
+    else {
+      partCharged = dst->budget != NULL;
+      part = allocTable(dst, dst->i);
+      if (part == NULL)
+        status = STACK_NO_MEMORY;
+    }
+  }
+  if (status == STACK_OK)
+    fresh = newTable(src, src->initialSize, &status);
+  if (fresh == NULL) {
+    // Undo only what was charged, freeTable returns the bytes of part
+    if (part != NULL)
+      freeTable(dst, part);
+    else if (partCharged)
+      atomic_fetch_sub(&dst->budget->used, partBytes);
+    if (dst->budget != src->budget) {
+      if (dst->budget != NULL)
+        atomic_fetch_sub(&dst->budget->used, bytes);
+      if (src->budget != NULL)
+        atomic_fetch_add(&src->budget->used, bytes);
+    }
+    return status;
+  }
+
+  top = dst->head;
+  if (part != NULL) {
+    memcpy(part->Items, top->Items, partBytes);
+    part->next = top->next;
+    part->prev = NULL;
+    if (top->next != NULL)
+      top->next->prev = part;
+    else
+      dst->tail = part;
+    dst->head = part;
+    dst->nResident++;
+    releaseTable(dst, top);
+    top = part;
+  } else if (dst->i == 0) {
+    dst->head = top->next;
+    if (dst->head == NULL)
+      dst->tail = NULL;
+    else
+      dst->head->prev = NULL;
+    releaseTable(dst, top);
+    top = dst->head;
+  }
+
+  src->tail->next = top;
+  if (top != NULL)
+    top->prev = src->tail;
+  else
+    dst->tail = src->tail;
+  dst->head = src->head;
+  dst->n = src->n;
+  dst->i = src->i;
+  dst->count += src->count;
+  dst->nResident += src->nResident;
+  dst->tableBytes += bytes;
+  src->tableBytes -= bytes;
+  if (dst->filter != NULL) {
+    for (node_ptr = dst->head; node_ptr != top; node_ptr = node_ptr->next) {
+      count = node_ptr == dst->head ? dst->i : node_ptr->n;
+      for (j = 0; j < count; j++)
+        filterUpdate(dst, node_ptr->Items + j * dst->itemSize, 1);
+    }
+  }
+  if (dst->hotTables != 0)
+    while (dst->nResident > dst->hotTables && spillTable(dst))
+      ;
+
+  fresh->next = NULL;
+  fresh->prev = NULL;
+  src->head = fresh;
+  src->tail = fresh;
+  src->n = fresh->n;
+  src->i = 0;
+  src->count = 0;
+  src->nResident = 1;
+  if (src->filter != NULL)
+    memset(src->filter, 0, src->filterSize);
+  return STACK_OK;
+}
+/* Description: Allocates a table for stackSplitBottom, charging its bytes to
+ * the Stack's budget even if that exceeds it.
+ * Return: The new table.
+ * */
+static struct node *splitTable(Stack *stack, size_t n) {
+  struct node *new_node;
+
+  new_node = allocTable(stack, n);
+  if (new_node == NULL)
+    exit(0);
+  if (stack->budget != NULL)
+    atomic_fetch_add(&stack->budget->used, n * stack->itemSize);
+  return new_node;
+}
+/* Description: Hands a table unlinked by stackSplitBottom over to the new
+ * Stack, reading it back into memory if it was spilled.
+ * */
+static void moveSplitTable(Stack *stack, Stack *newSt, struct node *node) {
+  size_t bytes;
+  void *items;
+
+  bytes = node->n * stack->itemSize;
+  if (node->Items == NULL) {
+    items = tableItems(stack, node);
+    if (!allocItems(newSt, node))
+      exit(0);
+    memcpy(node->Items, items, bytes);
+    free(node->packed);
+    node->packed = NULL;
+    if (stack->scratchNode == node)
+      stack->scratchNode = NULL;
+    if (stack->spillTop == node)
+      stack->spillTop = NULL;
+  } else {
+    stack->tableBytes -= bytes;
+    newSt->tableBytes += bytes;
+    if (stack->budget != NULL)
+      atomic_fetch_sub(&stack->budget->used, bytes);
+    stack->nResident--;
+  }
+  newSt->nResident++;
+}
+/* Description: Spills the table left at the bottom by stackSplitBottom in place
+ * of the spilled table it was cut from, keeping the spilled tables contiguous
+ * from the tail and in the order of the spill file.
+ * Return: 1 on success, 0 otherwise.
+ * */
+static int respillTable(Stack *stack, struct node *rest, struct node *cut) {
+  if (stack->compress) {
+    if (!packTable(stack, rest))
+      return 0;
+  } else {
+#ifdef __unix__
+    if (pwrite(fileno(stack->spillFile), rest->Items,
+               rest->n * stack->itemSize,
+               (off_t)cut->offset) != (ssize_t)(rest->n * stack->itemSize))
+      return 0;
+    rest->offset = cut->offset;
+#else
+    return 0;
+#endif
+  }
+  freeItems(stack, rest);
+  if (stack->spillTop == NULL)
+    stack->spillTop = rest;
+  stack->nResident--;
+  return 1;
+}
+/* Description: Moves the k items at the bottom of the Stack to a new Stack,
+ * for instance to hand half of the work to another thread. Whole tables are
+ * unlinked from the bottom of the Stack, only the items of the table crossed
+ * by the split that stay in the Stack are copied, so the time taken is
+ * proportional to the tables moved. Spilled tables are read back into the new
+ * Stack, which has the Stack's settings, except for its budget, spilling and
+ * file.
+ * Arguments: Pointer to the Stack, without a backing file, and the number of
+ * items to move, which must not exceed the number of items in the Stack.
+ * Return: Pointer to the created Stack.
+ * */
+Stack *stackSplitBottom(Stack *stack, size_t k) {
+  struct node *node_ptr, *cut, *top, *oldHead, *oldTail, *rest;
+  size_t taken, count, end, oldI, j;
+  Stack *newSt;
+  void *item;
+  int spilled;
+
+  if (stack == NULL || k > stack->count || stack->fileFd >= 0)
+    exit(0);
+  newSt = newStackLike(stack);
+  if (newSt->filter != NULL)
+    memset(newSt->filter, 0, newSt->filterSize);
+
+  // Find the table crossed by the split, NULL if every table moves
+  taken = 0;
+  end = 0;
+  for (cut = stack->tail; cut != NULL; cut = cut->prev) {
+    end = cut == stack->head ? stack->i : cut->n;
+    if (taken + end > k)
+      break;
+    taken += end;
+  }
+  oldHead = stack->head;
+  oldTail = stack->tail;
+  oldI = stack->i;
+  rest = NULL;
+  if (cut == NULL) {
+    rest = splitTable(stack, stack->initialSize);
+    top = oldHead;
+  } else if (k > taken) {
+    // The items of cut above the split stay, in a table of their own
+    rest = splitTable(stack, cut->n - (k - taken));
+    memcpy(rest->Items,
+           tableItems(stack, cut) + (k - taken) * stack->itemSize,
+           (end - (k - taken)) * stack->itemSize);
+    top = cut;
+  } else {
+    top = cut->next;
+  }
+  spilled = cut != NULL && cut->Items == NULL;
+
+  if (top != NULL) {
+    for (node_ptr = oldTail;; node_ptr = node_ptr->prev) {
+      moveSplitTable(stack, newSt, node_ptr);
+      if (stack->filter != NULL) {
+        count = node_ptr == cut       ? k - taken
+                : node_ptr == oldHead ? oldI
+                                      : node_ptr->n;
+        for (j = 0; j < count; j++) {
+          item = node_ptr->Items + j * stack->itemSize;
+          filterUpdate(stack, item, -1);
+          filterUpdate(newSt, item, 1);
+        }
+      }
+      if (node_ptr == top)
+        break;
+    }
+  }
+
+  // Relink what stays, the table left at the bottom is full
+  if (cut == NULL) {
+    rest->prev = NULL;
+    stack->head = rest;
+    stack->n = rest->n;
+    stack->i = 0;
+  } else if (k > taken) {
+    rest->prev = cut->prev;
+    if (cut->prev != NULL) {
+      cut->prev->next = rest;
+    } else {
+      stack->head = rest;
+      stack->n = rest->n;
+      stack->i = end - (k - taken);
+    }
+  } else if (top != NULL) {
+    cut->next = NULL;
+    stack->tail = cut;
+  }
+  if (rest != NULL) {
+    rest->next = NULL;
+    stack->tail = rest;
+    stack->nResident++;
+  }
+  if (rest != NULL && spilled && !respillTable(stack, rest, cut))
+    exit(0);
+  stack->count -= k;
+
+  if (top == NULL) {
+    top = splitTable(newSt, newSt->initialSize);
+    top->next = NULL;
+    oldTail = top;
+    newSt->nResident = 1;
+    newSt->i = 0;
+  } else {
+    newSt->i = top == cut ? k - taken : top == oldHead ? oldI : top->n;
+  }
+  top->prev = NULL;
+  newSt->head = top;
+  newSt->tail = oldTail;
+  newSt->n = top->n;
+  newSt->count = k;
+  return newSt;
+}
+/* Description: Prepares an iterator over the items of the Stack, from the top
+ * to the bottom.
+ * Arguments: Pointer to the Stack and pointer to the iterator.
+ * */
+void stackIterTop(Stack *stack, StackIterator *it) {
+  if (stack == NULL || it == NULL)
+    exit(0);
+  it->stack = stack;
+  it->node = stack->head;
+  it->i = stack->i;
+  it->topDown = 1;
+}
+/* Description: Prepares an iterator over the items of the Stack, from the
+ * bottom to the top.
+ * Arguments: Pointer to the Stack and pointer to the iterator.
+ * */
+void stackIterBottom(Stack *stack, StackIterator *it) {
+  if (stack == NULL || it == NULL)
+    exit(0);
+  it->stack = stack;
+  it->node = stack->tail;
+  it->i = 0;
+  it->topDown = 0;
+}
+/* Description: Returns a pointer to the next item of the iteration, or NULL
+ * once every item was visited. Items are not copied, the pointer is valid until
+ * the Stack is modified or, for spilled tables, until the iteration moves to
+ * another table.
+ * */
+void *stackIterNext(StackIterator *it) {
+  struct node *node_ptr;
+  size_t end;
+
+  node_ptr = it->node;
+  if (it->topDown) {
+    while (it->i == 0) {
+      // Move to next table
+      if (node_ptr == NULL || node_ptr->next == NULL)
+        return NULL;
+      node_ptr = node_ptr->next;
+      it->node = node_ptr;
+      it->i = node_ptr->n;
+    }
+    it->i--;
+    return tableItems(it->stack, node_ptr) + it->i * it->stack->itemSize;
+  }
+
+  // Only the head table is partially filled
+  end = node_ptr->prev == NULL ? it->stack->i : node_ptr->n;
+  while (it->i == end) {
+    // Move to previous table
+    if (node_ptr->prev == NULL)
+      return NULL;
+    node_ptr = node_ptr->prev;
+    it->node = node_ptr;
+    it->i = 0;
+    end = node_ptr->prev == NULL ? it->stack->i : node_ptr->n;
+  }
+  it->i++;
+  return tableItems(it->stack, node_ptr) + (it->i - 1) * it->stack->itemSize;
+}
+/* Description: Calls visit on each table of the Stack, from the top to the
+ * bottom, with a pointer to the table's items and how many there are. Within a
+ * table the items are contiguous and ordered from the bottom to the top.
+ * Stops early if visit returns non zero.
+ * Arguments:
+ *  Stack *     - Pointer to Stack
+ *  ctx         - Pointer passed untouched to visit.
+ *  visit       - Function called for each table with items.
+ * Return: The last value returned by visit, 0 if it was never called.
+ * */
+int forEachTable(Stack *stack, void *ctx,
+                 int visit(void *ctx, void *items, size_t count)) {
+  struct node *node_ptr;
+  size_t count;
+  int ret;
+
+  if (stack == NULL)
+    exit(0);
+  ret = 0;
+  node_ptr = stack->head;
+  count = stack->i;
+  while (node_ptr != NULL) {
+    if (count > 0) {
+      ret = visit(ctx, tableItems(stack, node_ptr), count);
+      if (ret)
+        return ret;
+    }
+    node_ptr = node_ptr->next;
+    if (node_ptr != NULL)
+      count = node_ptr->n;
+  }
+  return ret;
+}
+/* Description: Allocates a persistent Stack version with no items. Versions
+ * are immutable: push and pop return new versions sharing the items of the
+ * one they come from, which stay valid until freed with freePStack.
+ * Arguments: The initial size of the chunks in items, and the size of each
+ * item in bytes.
+ * Return: Pointer to the created version.
+ * */
+PStack *initPStack(size_t initial_size, size_t item_size) {
+  PStack *version;
+
+  if (initial_size == 0)
+    exit(0);
+  version = (PStack *)malloc(sizeof(PStack));
+  if (version == NULL)
+    exit(0);
+  version->chunk = NULL;
+  version->fill = 0;
+  version->itemSize = item_size;
+  version->initialSize = initial_size;
+  return version;
+}
+/* Description: Allocates a version of the same persistent Stack as another one.
+ * Return: Pointer to the created version, holding a reference to chunk.
+ * */
+static PStack *newVersion(PStack *from, struct pchunk *chunk, size_t fill) {
+  PStack *version;
+
+  version = initPStack(from->initialSize, from->itemSize);
+  if (chunk != NULL)
+    atomic_fetch_add(&chunk->refs, 1);
+  version->chunk = chunk;
+  version->fill = fill;
+  return version;
+}
+/* Description: Frees a version of a persistent Stack. Chunks are freed once no
+ * other version shares them. Other versions are not affected.
+ * */
+void freePStack(PStack *version) {
+  struct pchunk *chunk, *parent;
+
+  if (version == NULL)
+    exit(0);
+  chunk = version->chunk;
+  while (chunk != NULL && atomic_fetch_sub(&chunk->refs, 1) == 1) {
+    parent = chunk->parent;
+    free(chunk);
+    chunk = parent;
+  }
+  free(version);
+}
+/* Description: Returns 1 if the version of a persistent Stack is empty, 0
+ * otherwise.
+ * */
+int isPStackEmpty(PStack *version) { return version->chunk == NULL; }
+/* Description: Creates a version of a persistent Stack with one more item on
+ * top. The item is appended to the version's chunk if no other version has
+ * written past it, otherwise a new chunk is started on top of it, so items
+ * are never copied and branching from any version is O(1).
+ * Arguments: Pointer to the version and pointer to the item to be copied.
+ * Return: Pointer to the created version, freed with freePStack.
+ * */
+PStack *pstackPush(PStack *version, void *item) {
+  struct pchunk *chunk;
+  size_t fill, n;
+
+  if (version == NULL)
+    exit(0);
+  chunk = version->chunk;
+  fill = version->fill;
+  if (chunk != NULL && fill < chunk->n &&
+      atomic_compare_exchange_strong(&chunk->used, &fill, fill + 1)) {
+    // This version was the first to write past fill
+    memcpy(chunk->Items + fill * version->itemSize, item, version->itemSize);
+    return newVersion(version, chunk, fill + 1);
+  }
+
+  // Grow linearly on top of full chunks, start small when branching
+  fill = version->fill;
+  n = version->initialSize;
+  if (chunk != NULL && fill == chunk->n) {
+    n = chunk->n + version->initialSize;
+    if (n < chunk->n)
+      exit(0);
+  }
+  if (version->itemSize != 0 &&
+      n > (SIZE_MAX - sizeof(struct pchunk)) / version->itemSize)
+    exit(0);
+  chunk = (struct pchunk *)malloc(sizeof(struct pchunk) +
+                                  n * version->itemSize);
+  if (chunk == NULL)
+    exit(0);
+  atomic_init(&chunk->refs, 0);
+  atomic_init(&chunk->used, 1);
+  chunk->n = n;
+  chunk->parent = version->chunk;
+  chunk->parentFill = fill;
+  if (chunk->parent != NULL)
+    atomic_fetch_add(&chunk->parent->refs, 1);
+  memcpy(chunk->Items, item, version->itemSize);
+  return newVersion(version, chunk, 1);
+}
+/* Description: Copies the top item of a version of a persistent Stack and
+ * returns the version below it. The version itself is left unchanged.
+ * Arguments: Pointer to the version and pointer with the destination address,
+ * or NULL to skip the copy.
+ * Return: Pointer to the version without the top item, freed with freePStack.
+ * */
+PStack *pstackPop(PStack *version, void *dest) {
+  struct pchunk *chunk;
+
+  if (version == NULL || version->chunk == NULL)
+    exit(0);
+  chunk = version->chunk;
+  if (dest != NULL)
+    memcpy(dest, chunk->Items + (version->fill - 1) * version->itemSize,
+           version->itemSize);
+  if (version->fill > 1)
+    return newVersion(version, chunk, version->fill - 1);
+  return newVersion(version, chunk->parent, chunk->parentFill);
+}
+/* Description: Allocates a Stack that keeps track of its minimum and maximum
+ * items, so that stackMin and stackMax take constant time. Items are stored
+ * like in any Stack, with two more Stacks holding the items that were the
+ * minimum or maximum when pushed.
+ * Arguments: The initial size of the stack in items, the size of each item in
+ * bytes, and the function ordering the items, returning a negative value, 0
+ * or a positive value if the first item is smaller, equal or greater.
+ * Return: Pointer to the created Stack.
+ * */
+MinMaxStack *initMinMaxStack(size_t initial_size, size_t item_size,
+                             int compare(void *, void *)) {
+  MinMaxStack *newSt;
+
+  newSt = (MinMaxStack *)malloc(sizeof(MinMaxStack));
+  if (newSt == NULL)
+    exit(0);
+  newSt->items = initStack(initial_size, item_size);
+  newSt->mins = initStack(initial_size, item_size);
+  newSt->maxs = initStack(initial_size, item_size);
+  newSt->compare = compare;
+  return newSt;
+}
+/* Description: Frees a MinMaxStack object and its contents.
+ * */
+void freeMinMaxStack(MinMaxStack *stack) {
+  if (stack == NULL)
+    exit(0);
+  freeStack(stack->items);
+  freeStack(stack->mins);
+  freeStack(stack->maxs);
+  free(stack);
+}
+/* Description: Returns the Stack holding the items of a MinMaxStack, to search
+ * or traverse them. It must not be modified directly.
+ * */
+Stack *minMaxItems(MinMaxStack *stack) { return stack->items; }
+/* Description: Returns a pointer to the top item of a Stack, NULL if it is
+ * empty.
+ * */
+static void *stackTop(Stack *stack) {
+  StackIterator it;
+
+  stackIterTop(stack, &it);
+  return stackIterNext(&it);
+}
+/* Description: Copies an item to the top of a MinMaxStack, updating its
+ * minimum and maximum.
+ * Arguments: Pointer to the Stack and pointer to the item to be copied.
+ * */
+void minMaxPush(MinMaxStack *stack, void *item) {
+  void *top;
+
+  if (stack == NULL)
+    exit(0);
+  push(stack->items, item);
+  top = stackTop(stack->mins);
+  if (top == NULL || stack->compare(item, top) <= 0)
+    push(stack->mins, item);
+  top = stackTop(stack->maxs);
+  if (top == NULL || stack->compare(item, top) >= 0)
+    push(stack->maxs, item);
+}
+/* Description: Copies an item from the top of a MinMaxStack and deletes it
+ * from the Stack, updating its minimum and maximum.
+ * Arguments: Pointer to the Stack and pointer with the destination address,
+ * or NULL to skip the copy.
+ * Return: STACK_OK, or STACK_EMPTY if the Stack was empty.
+ * */
+StackStatus minMaxPop(MinMaxStack *stack, void *dest) {
+  void *top;
+
+  if (stack == NULL)
+    exit(0);
+  top = stackTop(stack->items);
+  if (top == NULL)
+    return STACK_EMPTY;
+  if (stack->compare(top, stackTop(stack->mins)) == 0)
+    drop(stack->mins);
+  if (stack->compare(top, stackTop(stack->maxs)) == 0)
+    drop(stack->maxs);
+  if (dest == NULL) {
+    drop(stack->items);
+    return STACK_OK;
+  }
+  return tryPop(stack->items, dest);
+}
+/* Description: Copies the minimum item of a MinMaxStack, in constant time.
+ * Arguments: Pointer to the Stack and pointer with the destination address.
+ * Return: STACK_OK, or STACK_EMPTY if the Stack is empty.
+ * */
+StackStatus stackMin(MinMaxStack *stack, void *dest) {
+  void *top;
+
+  if (stack == NULL)
+    exit(0);
+  top = stackTop(stack->mins);
+  if (top == NULL)
+    return STACK_EMPTY;
+  memcpy(dest, top, stack->items->itemSize);
+  return STACK_OK;
+}
+/* Description: Copies the maximum item of a MinMaxStack, in constant time.
+ * Arguments: Pointer to the Stack and pointer with the destination address.
+ * Return: STACK_OK, or STACK_EMPTY if the Stack is empty.
+ * */
+StackStatus stackMax(MinMaxStack *stack, void *dest) {
+  void *top;
+
+  if (stack == NULL)
+    exit(0);
+  top = stackTop(stack->maxs);
+  if (top == NULL)
+    return STACK_EMPTY;
+  memcpy(dest, top, stack->items->itemSize);
+  return STACK_OK;
 }
@@ -25,19 +25,79 @@
  *  Function list:
  *    A) Initialization & Termination
  *        initStack
+ *        tryInitStack
+ *        openStackFile
+ *        tryOpenStackFile
+ *        syncStack
+ *        saveStack
+ *        loadStack
+ *        stackSnapshot
+ *        cloneStack
  *        freeStack
+ *        clearStack
+ *        setStackSpareTables
+ *        setStackAlignment
+ *        setStackLimit
+ *        initStackBudget
+ *        freeStackBudget
+ *        setStackBudget
+ *        setStackFilter
+ *        setStackSpill
+ *        setStackCompress
+ *        compactStack
+ *        setStackAutoCompact
+ *        setStackDeferredFree
  *
  *    B) Properties
  *        isStackEmpty
+ *        getStackStats
+ *        stackBudgetUsed
  *
  *    C) Search
  *        itemExists
+ *        itemExistsBatch
+ *        itemExistsParallel
+ *        stackFind
+ *        stackFindAll
  *
  *    D) Insertion & Removal
  *       push
+ *       tryPush
  *		 pop
+ *       tryPop
+ *       drop
+ *       dropN
+ *       stackMark
+ *       stackRollback
+ *       stackSplice
+ *       stackSplitBottom
+ *
+ *    E) Traversal
+ *       stackIterTop
+ *       stackIterBottom
+ *       stackIterNext
+ *       forEachTable
+ *
+ *    F) Persistent Stack
+ *       initPStack
+ *       freePStack
+ *       isPStackEmpty
+ *       pstackPush
+ *       pstackPop
+ *
+ *    G) Min/Max Stack
+ *       initMinMaxStack
+ *       freeMinMaxStack
+ *       minMaxItems
+ *       minMaxPush
+ *       minMaxPop
+ *       stackMin
+ *       stackMax
  *
  *	Dependencies:
+ *    math.h
+ *    pthread.h
+ *    stdio.h
  *    stdlib.h
  *	  string.h
  *
@@ -46,7 +106,50 @@
 #ifndef GENERALSTACK_H_INCLUDED
 #define GENERALSTACK_H_INCLUDED
 
+#include <stddef.h>
+#include <stdio.h>
+
 typedef struct _stack Stack;
+typedef struct _stackBudget StackBudget;
+typedef struct _pstack PStack;
+typedef struct _minMaxStack MinMaxStack;
+
+/* Result of the functions that report failures instead of exiting. */
+typedef enum {
+  STACK_OK = 0,    // Success
+  STACK_EMPTY,     // The Stack has no items
+  STACK_NO_MEMORY, // A table could not be allocated
+  STACK_OVERFLOW,  // A size does not fit in a size_t
+  STACK_FULL,      // A limit or budget of the Stack was reached
+  STACK_IO_ERROR,  // Reading or writing a file failed
+  STACK_BAD_FILE   // A file does not hold a compatible Stack
+} StackStatus;
+typedef size_t StackMark;
+
+/* Iterator over the items of a Stack, see stackIterTop and stackIterBottom.
+ * Its fields are private.
+ * */
+typedef struct {
+  Stack *stack;
+  void *node;
+  size_t i;
+  int topDown;
+} StackIterator;
+
+/* Item count and memory use of a Stack, see getStackStats. */
+typedef struct {
+  size_t items;            // Number of items
+  size_t tables;           // Number of tables in use
+  size_t spareTables;      // Number of spare tables
+  size_t tableBytes;       // Bytes of the tables in use
+  size_t spareBytes;       // Bytes of the spare tables
+  size_t filterBytes;      // Bytes of the filter, see setStackFilter
+  size_t spilledTables;    // Number of tables spilled, see setStackSpill
+  size_t spilledBytes;     // Bytes of the spilled tables
+  size_t compressedTables; // Number of tables compressed, see setStackCompress
+  size_t compressedBytes;  // Bytes of the compressed tables
+  size_t savedBytes;       // Bytes saved by compressing them
+} StackStats;
 
 /* Description: Allocates a Stack object and initializes it with the
  * specified size.
@@ -54,27 +157,307 @@ typedef struct _stack Stack;
  * size of each item in bytes.
  * Return: Pointer to the created Stack.
  * */
-Stack *initStack(unsigned int initial_size, unsigned int item_size);
+Stack *initStack(size_t initial_size, size_t item_size);
+
+/* Description: Same as initStack, but returns a status instead of exiting if
+ * the Stack cannot be allocated.
+ * Arguments: Pointer where the created Stack is stored, the initial size of
+ * the stack in items, and the size of each item in bytes.
+ * Return: STACK_OK, or STACK_NO_MEMORY if the allocation failed.
+ * */
+StackStatus tryInitStack(Stack **stack, size_t initial_size, size_t item_size);
 
-/* Description: Frees a Stack object and its contents.
+/* Description: Opens a Stack whose tables live in a file, creating the file if
+ * it does not exist. The tables are mapped in place, so opening an existing
+ * file reads none of its items, and push and pop work as for any Stack. Use
+ * syncStack to make the file consistent on disk, freeStack to close it. A
+ * file left by a crash opens with the number of items of its last sync, but
+ * items are written in place, so those popped and pushed again since that
+ * sync hold their new values.
+ * Arguments:
+ *  path         - Path of the file.
+ *  initial_size - Initial size of the stack in items, if the file is created.
+ *  item_size    - Size of each item in bytes, must match an existing file.
+ * Return: Pointer to the opened Stack.
+ * */
+Stack *openStackFile(const char *path, size_t initial_size, size_t item_size);
+
+/* Description: Same as openStackFile, but returns a status instead of exiting
+ * if the file cannot be opened.
+ * Arguments: Pointer where the opened Stack is stored, then the same as
+ * openStackFile.
+ * Return: STACK_OK, STACK_IO_ERROR if the file could not be read or extended,
+ * STACK_BAD_FILE if it is not a Stack file with items of item_size bytes, or
+ * STACK_NO_MEMORY.
+ * */
+StackStatus tryOpenStackFile(Stack **stack, const char *path,
+                             size_t initial_size, size_t item_size);
+
+/* Description: Writes the Stack's state to its backing file's header and
+ * flushes the file to disk. Until the next sync, reopening the file after a
+ * crash restores the number of items and tables of this sync. Only the header
+ * is checkpointed: items are written in place, so items popped and pushed
+ * again after this sync keep their new values. Does nothing for Stacks
+ * without a backing file.
+ * Return: STACK_OK, or STACK_IO_ERROR if flushing failed.
+ * */
+StackStatus syncStack(Stack *);
+
+/* Description: Writes the items of the Stack to a file, after a short header,
+ * with one write per table from the bottom of the Stack. The Stack is left
+ * unchanged and can be read back with loadStack.
+ * Arguments: Pointer to the Stack and the file, open for writing.
+ * Return: STACK_OK, or STACK_IO_ERROR if writing failed.
+ * */
+StackStatus saveStack(Stack *, FILE *);
+
+/* Description: Creates a Stack from one written by saveStack. All of its
+ * items are read into a single table, sized to hold them.
+ * Arguments: Pointer where the created Stack is stored, and the file, open
+ * for reading at the start of the saved Stack.
+ * Return: STACK_OK, STACK_IO_ERROR if reading failed, STACK_BAD_FILE if the
+ * file does not hold a saved Stack, or STACK_NO_MEMORY.
+ * */
+StackStatus loadStack(Stack **stack, FILE *);
+
+/* Description: Creates a copy of the Stack that shares its tables in memory
+ * instead of copying their items. A shared table is copied only when either
+ * Stack pushes into it, so memory grows with the divergence of the two.
+ * Spilled tables and tables of a backing file are copied into memory. The
+ * copy has the Stack's settings, except for its budget, spilling and file.
+ * Arguments: Pointer to the Stack.
+ * Return: Pointer to the created Stack.
+ * */
+Stack *stackSnapshot(Stack *);
+
+/* Description: Creates an independent copy of the Stack, with all of its
+ * items in a single table sized to hold them. Each table of the Stack is
+ * copied with one memcpy. The copy has the Stack's settings, except for its
+ * budget, spilling and file.
+ * Arguments: Pointer to the Stack.
+ * Return: Pointer to the created Stack.
+ * */
+Stack *cloneStack(Stack *);
+
+/* Description: Frees a Stack object and its contents. If the Stack defers
+ * freeing its tables, see setStackDeferredFree, they are freed on a detached
+ * thread and freeStack returns at once. Their bytes are returned to the
+ * Stack's budget before freeStack returns.
  * */
 void freeStack(Stack *);
 
+/* Description: Deletes every item in the Stack without copying them, keeping
+ * the starting table. The other tables are freed or kept as spare capacity,
+ * see setStackSpareTables.
+ * */
+void clearStack(Stack *);
+
+/* Description: Sets the maximum number of emptied tables the Stack keeps
+ * allocated for reuse by later pushes, instead of freeing them. Default is 0.
+ * Arguments: Pointer to the Stack and the maximum number of spare tables.
+ * */
+void setStackSpareTables(Stack *, size_t max_tables);
+
+/* Description: Sets the alignment of the tables allocated from now on, and the
+ * table size from which they are mapped directly from the system, backed by
+ * huge pages where supported. The defaults are 64 bytes and 64 MiB.
+ * Arguments:
+ *  Stack *        - Pointer to Stack
+ *  alignment      - Alignment in bytes, a power of two multiple of
+ *                   sizeof(void *).
+ *  huge_threshold - Table size in bytes from which tables are mapped, 0 to
+ *                   never map them.
+ * */
+void setStackAlignment(Stack *, size_t alignment, size_t huge_threshold);
+
+/* Description: Limits the number of items of the Stack and the bytes of its
+ * tables, spare ones included. Once a limit is reached tryPush returns
+ * STACK_FULL. Lowering a limit below the current use frees nothing.
+ * Arguments:
+ *  Stack *   - Pointer to Stack
+ *  max_items - Maximum number of items, 0 for no limit.
+ *  max_bytes - Maximum bytes of the tables, 0 for no limit.
+ * */
+void setStackLimit(Stack *, size_t max_items, size_t max_bytes);
+
+/* Description: Allocates a byte budget that can be shared by several Stacks,
+ * possibly used from different threads, see setStackBudget.
+ * Arguments: Maximum bytes of the tables of all Stacks using the budget.
+ * Return: Pointer to the created budget.
+ * */
+StackBudget *initStackBudget(size_t max_bytes);
+
+/* Description: Frees a budget. No Stack may be using it anymore.
+ * */
+void freeStackBudget(StackBudget *);
+
+/* Description: Makes the Stack's tables count against a budget. The tables the
+ * Stack already has are charged at once, even if that exceeds the budget, and
+ * new tables that would exceed it make tryPush return STACK_FULL.
+ * Arguments: Pointer to the Stack and pointer to the budget, NULL to stop
+ * using one.
+ * */
+void setStackBudget(Stack *, StackBudget *budget);
+
+/* Description: Enables a counting Bloom filter of the Stack's items, consulted
+ * by the searches before scanning the tables, so that most searches for items
+ * not in the Stack return immediately. Once enabled, drop, dropN and
+ * stackRollback have to read the items they delete.
+ * Arguments:
+ *  Stack *        - Pointer to Stack
+ *  expected_items - Number of items the filter is sized for.
+ *  fp_rate        - Wanted false positive rate with expected_items items,
+ *                   between 0 and 1.
+ *  hash           - Hash function of the items, must return the same value
+ *                   for items that are equal for the searches. NULL disables
+ *                   the filter.
+ * */
+void setStackFilter(Stack *, size_t expected_items, double fp_rate,
+                    unsigned long hash(void *));
+
+/* Description: Keeps only the hot_tables topmost tables in memory, writing
+ * colder tables to a temporary file as new tables are pushed, and reading them
+ * back when pop reaches them. Searches read spilled tables from the file.
+ * Arguments: Pointer to the Stack and the number of tables kept in memory, 0
+ * to read every spilled table back and stop spilling.
+ * Return: STACK_OK, or STACK_IO_ERROR, STACK_NO_MEMORY if the file could not
+ * be created or the tables read back. Stacks with a backing file cannot spill.
+ * */
+StackStatus setStackSpill(Stack *, size_t hot_tables);
+
+/* Description: Same as setStackSpill, but compresses the cold tables in
+ * memory instead of writing them to a file. Pop decompresses them back when it
+ * reaches them, and searches decompress them into a scratch buffer. Enabling
+ * one of the two modes first reads back the tables spilled by the other.
+ * Arguments: Pointer to the Stack and the number of tables kept uncompressed,
+ * 0 to decompress every table and stop compressing.
+ * Return: STACK_OK, STACK_NO_MEMORY if the tables could not be read back, or
+ * STACK_IO_ERROR for Stacks with a backing file.
+ * */
+StackStatus setStackCompress(Stack *, size_t hot_tables);
+
+/* Description: Merges adjacent tables in memory into one contiguous table, so
+ * that searches and iterations cross fewer tables. Each call merges at most
+ * max_tables tables, choosing the adjacent ones with the fewest bytes, so the
+ * time taken is bounded and repeated calls even out the tables' sizes. Stacks
+ * with a backing file are left unchanged.
+ * Arguments: Pointer to the Stack and the maximum number of tables to merge, 0
+ * to merge every table in memory.
+ * Return: STACK_OK, STACK_FULL if the Stack's limits or budget do not allow a
+ * copy of the merged tables, or STACK_NO_MEMORY.
+ * */
+StackStatus compactStack(Stack *, size_t max_tables);
+
+/* Description: Compacts the Stack automatically: once it holds more than
+ * max_tables tables in memory, each push that adds a table also merges
+ * merge_tables of them, see compactStack.
+ * Arguments: Pointer to the Stack, the number of tables in memory from which
+ * to compact, 0 to never compact automatically, and the number of tables
+ * merged each time, 0 to merge them all.
+ * */
+void setStackAutoCompact(Stack *, size_t max_tables, size_t merge_tables);
+
+/* Description: Defers freeing the tables the Stack releases, so that releasing
+ * many tables does not stall the caller. clearStack hands its tables over at
+ * once, and each later push or pop frees at most tables_per_op of them.
+ * freeStack frees the whole Stack on a detached thread. Stacks with a backing
+ * file always free their tables at once.
+ * Arguments: Pointer to the Stack and the number of tables freed by each push
+ * or pop, 0 to free tables at once again, including the deferred ones.
+ * */
+void setStackDeferredFree(Stack *, size_t tables_per_op);
+
 /* Description: Returns 1 if the Stack is empty, 0 otherwise.
  * */
 int isStackEmpty(Stack *);
 
+/* Description: Fills stats with the Stack's current item count and memory use.
+ * Arguments: Pointer to the Stack and pointer to the statistics to fill.
+ * */
+void getStackStats(Stack *, StackStats *stats);
+
+/* Description: Returns the bytes currently charged to a budget.
+ * */
+size_t stackBudgetUsed(StackBudget *);
+
 /* Description: Copies an item to the top of the Stack.
  * Arguments: Pointer to the Stack and pointer to the item to be copied.
  * */
 void push(Stack *, void *item);
 
+/* Description: Same as push, but returns a status instead of exiting if the
+ * item cannot be pushed. The Stack is unchanged in that case.
+ * Arguments: Pointer to the Stack and pointer to the item to be copied.
+ * Return: STACK_OK, STACK_FULL if the Stack's limits or budget would be
+ * exceeded, STACK_NO_MEMORY if a new table could not be allocated, or
+ * STACK_OVERFLOW if the new table's size does not fit in a size_t.
+ * */
+StackStatus tryPush(Stack *, void *item);
+
 /* Description: Copies an item from the top of the Stack and deletes it from the
  * Stack.
  * Arguments: Pointer to the Stack and pointer with the destination address
  * */
 void pop(Stack *, void *dest);
 
+/* Description: Same as pop, but returns STACK_EMPTY instead of exiting if the
+ * Stack is empty, so that no separate isStackEmpty check is needed.
+ * Arguments: Pointer to the Stack and pointer with the destination address.
+ * Return: STACK_OK, STACK_EMPTY if the Stack was empty, or STACK_NO_MEMORY or
+ * STACK_IO_ERROR if a spilled table could not be read back.
+ * */
+StackStatus tryPop(Stack *, void *dest);
+
+/* Description: Deletes the item at the top of the Stack without copying it.
+ * */
+void drop(Stack *);
+
+/* Description: Deletes the k items at the top of the Stack without copying
+ * them, in time proportional to the tables crossed.
+ * Arguments: Pointer to the Stack and the number of items to delete, which
+ * must not exceed the number of items in the Stack.
+ * */
+void dropN(Stack *, size_t k);
+
+/* Description: Returns a checkpoint of the current state of the Stack, to be
+ * later restored with stackRollback.
+ * */
+StackMark stackMark(Stack *);
+
+/* Description: Deletes every item pushed since the checkpoint was taken,
+ * without copying them, in time proportional to the tables crossed.
+ * Arguments: Pointer to the Stack and a checkpoint returned by stackMark. The
+ * Stack must not have been popped below the checkpoint.
+ * */
+void stackRollback(Stack *, StackMark mark);
+
+/* Description: Moves every item of src on top of dst, leaving src empty. The
+ * tables of src are relinked onto dst instead of copied, only the items of
+ * dst's partially filled top table are, so the time taken is proportional to
+ * the tables moved. If dst has a filter, the moved items are added to it.
+ * Stacks with a backing file, or a src with spilled tables, are copied item
+ * by item instead.
+ * Arguments: Pointer to the destination Stack and pointer to the source Stack,
+ * with items of the same size.
+ * Return: STACK_OK, STACK_FULL if dst's limits or budget would be exceeded,
+ * or STACK_NO_MEMORY. On failure src is unchanged, though dst may hold part
+ * of its items if they were copied.
+ * */
+StackStatus stackSplice(Stack *dst, Stack *src);
+
+/* Description: Moves the k items at the bottom of the Stack to a new Stack,
+ * for instance to hand half of the work to another thread. Whole tables are
+ * unlinked from the bottom of the Stack, only the items of the table crossed
+ * by the split that stay in the Stack are copied, so the time taken is
+ * proportional to the tables moved. Spilled tables are read back into the new
+ * Stack, which has the Stack's settings, except for its budget, spilling and
+ * file.
+ * Arguments: Pointer to the Stack, without a backing file, and the number of
+ * items to move, which must not exceed the number of items in the Stack.
+ * Return: Pointer to the created Stack.
+ * */
+Stack *stackSplitBottom(Stack *, size_t k);
+
 /* Description: Returns 1 if the item already exists in the Stack, 0 otherwise.
  * Arguments:
  *  Stack *     - Pointer to Stack
@@ -83,6 +466,189 @@ void pop(Stack *, void *dest);
  *  equal       - Function used to compare the items, must be 0 for different
  *                items.
  * */
-int itemExists(Stack *, void *item, int max_depth, int equal(void *, void *));
+int itemExists(Stack *, void *item, long max_depth,
+               int equal(void *, void *));
+
+/* Description: Checks several items for existence in the Stack with a single
+ * traversal.
+ * Arguments:
+ *  Stack *     - Pointer to Stack
+ *  items       - Array of count items to search for.
+ *  count       - Number of items to search for.
+ *  results     - Array of count ints, each set to 1 if the corresponding item
+ *                exists in the Stack, 0 otherwise.
+ *  max_depth   - Maximum number of Stack items to check. -1 for no limit.
+ *  equal       - Function used to compare the items, must be 0 for different
+ *                items.
+ * Return: Number of items found.
+ * */
+size_t itemExistsBatch(Stack *, void *items, size_t count,
+                       int *results, long max_depth,
+                       int equal(void *, void *));
+
+/* Description: Same as itemExists, but splits the items to check in n_threads
+ * contiguous ranges of depth searched in parallel. The topmost match is always
+ * the one reported, regardless of which thread finishes first.
+ * Arguments:
+ *  Stack *     - Pointer to Stack
+ *  item        - Pointer to item to search for.
+ *  max_depth   - Maximum number of items to check. -1 for no limit.
+ *  equal       - Function used to compare the items, must be 0 for different
+ *                items. Called concurrently from several threads.
+ *  n_threads   - Number of threads to use, including the calling one.
+ *  depth       - If not NULL, set to the depth of the topmost match, 0 being
+ *                the top of the Stack.
+ * Return: 1 if the item exists in the Stack, 0 otherwise.
+ * */
+int itemExistsParallel(Stack *, void *item, long max_depth,
+                       int equal(void *, void *), size_t n_threads,
+                       size_t *depth);
+
+/* Description: Searches the Stack from the top for the first item satisfying
+ * pred.
+ * Arguments:
+ *  Stack *     - Pointer to Stack
+ *  ctx         - Pointer passed untouched to pred.
+ *  pred        - Function called with ctx and an item, must be 0 for items
+ *                that do not match.
+ *  max_depth   - Maximum number of items to check. -1 for no limit.
+ *  depth       - If not NULL, set to the depth of the item found, 0 being the
+ *                top of the Stack.
+ * Return: Pointer to the item found inside the Stack, NULL if none matched.
+ * The pointer is valid until the Stack is modified or, if the item's table is
+ * spilled, searched again.
+ * */
+void *stackFind(Stack *, void *ctx, int pred(void *ctx, void *item),
+                long max_depth, size_t *depth);
+
+/* Description: Searches the Stack from the top for every item satisfying pred
+ * and stores their depths, 0 being the top of the Stack.
+ * Arguments:
+ *  Stack *     - Pointer to Stack
+ *  ctx         - Pointer passed untouched to pred.
+ *  pred        - Function called with ctx and an item, must be 0 for items
+ *                that do not match.
+ *  max_depth   - Maximum number of items to check. -1 for no limit.
+ *  depths      - Array where the depths of the matching items are stored.
+ *  max_results - Size of depths, the search stops once it is full.
+ * Return: Number of depths stored.
+ * */
+size_t stackFindAll(Stack *, void *ctx, int pred(void *ctx, void *item),
+                    long max_depth, size_t *depths, size_t max_results);
+
+/* Description: Prepares an iterator over the items of the Stack, from the top
+ * to the bottom.
+ * Arguments: Pointer to the Stack and pointer to the iterator.
+ * */
+void stackIterTop(Stack *, StackIterator *it);
+
+/* Description: Prepares an iterator over the items of the Stack, from the
+ * bottom to the top.
+ * Arguments: Pointer to the Stack and pointer to the iterator.
+ * */
+void stackIterBottom(Stack *, StackIterator *it);
+
+/* Description: Returns a pointer to the next item of the iteration, or NULL
+ * once every item was visited. Items are not copied, the pointer is valid until
+ * the Stack is modified or, for spilled tables, until the iteration moves to
+ * another table.
+ * */
+void *stackIterNext(StackIterator *it);
+
+/* Description: Calls visit on each table of the Stack, from the top to the
+ * bottom, with a pointer to the table's items and how many there are. Within a
+ * table the items are contiguous and ordered from the bottom to the top.
+ * Stops early if visit returns non zero.
+ * Arguments:
+ *  Stack *     - Pointer to Stack
+ *  ctx         - Pointer passed untouched to visit.
+ *  visit       - Function called for each table with items.
+ * Return: The last value returned by visit, 0 if it was never called.
+ * */
+int forEachTable(Stack *, void *ctx,
+                 int visit(void *ctx, void *items, size_t count));
+
+/* Description: Allocates a persistent Stack version with no items. Versions
+ * are immutable: push and pop return new versions sharing the items of the
+ * one they come from, which stay valid until freed with freePStack.
+ * Arguments: The initial size of the chunks in items, and the size of each
+ * item in bytes.
+ * Return: Pointer to the created version.
+ * */
+PStack *initPStack(size_t initial_size, size_t item_size);
+
+/* Description: Frees a version of a persistent Stack. Chunks are freed once no
+ * other version shares them. Other versions are not affected.
+ * */
+void freePStack(PStack *);
+
+/* Description: Returns 1 if the version of a persistent Stack is empty, 0
+ * otherwise.
+ * */
+int isPStackEmpty(PStack *);
+
+/* Description: Creates a version of a persistent Stack with one more item on
+ * top. The item is appended to the version's chunk if no other version has
+ * written past it, otherwise a new chunk is started on top of it, so items
+ * are never copied and branching from any version is O(1).
+ * Arguments: Pointer to the version and pointer to the item to be copied.
+ * Return: Pointer to the created version, freed with freePStack.
+ * */
+PStack *pstackPush(PStack *, void *item);
+
+/* Description: Copies the top item of a version of a persistent Stack and
+ * returns the version below it. The version itself is left unchanged.
+ * Arguments: Pointer to the version and pointer with the destination address,
+ * or NULL to skip the copy.
+ * Return: Pointer to the version without the top item, freed with freePStack.
+ * */
+PStack *pstackPop(PStack *, void *dest);
+
+/* Description: Allocates a Stack that keeps track of its minimum and maximum
+ * items, so that stackMin and stackMax take constant time. Items are stored
+ * like in any Stack, with two more Stacks holding the items that were the
+ * minimum or maximum when pushed.
+ * Arguments: The initial size of the stack in items, the size of each item in
+ * bytes, and the function ordering the items, returning a negative value, 0
+ * or a positive value if the first item is smaller, equal or greater.
+ * Return: Pointer to the created Stack.
+ * */
+MinMaxStack *initMinMaxStack(size_t initial_size, size_t item_size,
+                             int compare(void *, void *));
+
+/* Description: Frees a MinMaxStack object and its contents.
+ * */
+void freeMinMaxStack(MinMaxStack *);
+
+/* Description: Returns the Stack holding the items of a MinMaxStack, to search
+ * or traverse them. It must not be modified directly.
+ * */
+Stack *minMaxItems(MinMaxStack *);
+
+/* Description: Copies an item to the top of a MinMaxStack, updating its
+ * minimum and maximum.
+ * Arguments: Pointer to the Stack and pointer to the item to be copied.
+ * */
+void minMaxPush(MinMaxStack *, void *item);
+
+/* Description: Copies an item from the top of a MinMaxStack and deletes it
+ * from the Stack, updating its minimum and maximum.
+ * Arguments: Pointer to the Stack and pointer with the destination address,
+ * or NULL to skip the copy.
+ * Return: STACK_OK, or STACK_EMPTY if the Stack was empty.
+ * */
+StackStatus minMaxPop(MinMaxStack *, void *dest);
+
+/* Description: Copies the minimum item of a MinMaxStack, in constant time.
+ * Arguments: Pointer to the Stack and pointer with the destination address.
+ * Return: STACK_OK, or STACK_EMPTY if the Stack is empty.
+ * */
+StackStatus stackMin(MinMaxStack *, void *dest);
+
+/* Description: Copies the maximum item of a MinMaxStack, in constant time.
+ * Arguments: Pointer to the Stack and pointer with the destination address.
+ * Return: STACK_OK, or STACK_EMPTY if the Stack is empty.
+ * */
+StackStatus stackMax(MinMaxStack *, void *dest);
 
 #endif // GENERALSTACK_H_INCLUDED
@@ -0,0 +1,140 @@
+/******************************************************************************
+ *  Copyright (C) 2019 - Haohua Dong & Diogo Antunes
+ *
+ *  This file is a part of GeneralStack.
+ *
+ *  GeneralStack is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  GeneralStack is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * DESCRIPTION
+ *  Round-trip test of the codec used by setStackCompress. The codec is
+ *  private to generalStack.c, which is included here to reach it.
+ *
+ *  Build and run:
+ *      cc -O2 -o lzRoundTrip tests/lzRoundTrip.c -lm -pthread && ./lzRoundTrip
+ *
+ *****************************************************************************/
+
+#include "../generalStack.c"
+
+#define MAX_SIZE 4096
+#define ROUNDS 20000
+
+static unsigned long long seed = 88172645463325252ULL;
+
+static unsigned long long nextRandom(void) {
+  seed ^= seed << 13;
+  seed ^= seed >> 7;
+  seed ^= seed << 17;
+  return seed;
+}
+/* Description: Fills a buffer with random bytes from a small alphabet, with
+ * runs and copies of earlier data, so every kind of sequence shows up.
+ * */
+static void fillBuffer(unsigned char *buf, size_t size) {
+  size_t p, len, from;
+  unsigned alphabet;
+
+  alphabet = 1 + (unsigned)(nextRandom() % 256);
+  for (p = 0; p < size;) {
+    len = 1 + nextRandom() % 40;
+    if (len > size - p)
+      len = size - p;
+    switch (nextRandom() % 3) {
+    case 0:
+      for (; len > 0; len--)
+        buf[p++] = (unsigned char)(nextRandom() % alphabet);
+      break;
+    case 1:
+      memset(buf + p, (int)(nextRandom() % alphabet), len);
+      p += len;
+      break;
+    default:
+      if (p == 0)
+        break;
+      from = nextRandom() % p;
+      for (; len > 0; len--)
+        buf[p++] = buf[from++];
+    }
+  }
+}
+/* Description: Compresses buf into every capacity up to its size and checks
+ * that whatever fits decompresses back to it.
+ * Return: 1 if every round trip matched, 0 otherwise.
+ * */
+static int checkCodec(unsigned char *buf, size_t size) {
+  unsigned char packed[MAX_SIZE], out[MAX_SIZE];
+  size_t capacity, packedSize;
+
+  for (capacity = size; capacity + 8 > size && capacity > 0; capacity--) {
+    packedSize = lzCompress(buf, size, packed, capacity);
+    if (packedSize > capacity)
+      return 0;
+    if (packedSize != 0 &&
+        (!lzDecompress(packed, packedSize, out, size) ||
+         memcmp(out, buf, size) != 0))
+      return 0;
+  }
+  return 1;
+}
+/* Description: Compresses a table whose items compress to exactly the size of
+ * the table, which used to be read back as uncompressed items.
+ * Return: 1 if the items came back intact, 0 otherwise.
+ * */
+static int checkStack(void) {
+  unsigned char item[212], first[212], out[212];
+  Stack *stack;
+  size_t j;
+  int ok;
+
+  stack = initStack(1, sizeof(item));
+  if (setStackCompress(stack, 1) != STACK_OK)
+    return 0;
+  for (j = 0; j < sizeof(first); j++)
+    first[j] = (unsigned char)nextRandom();
+  memcpy(first + 100, first, 8);
+  push(stack, first);
+  memset(item, 0, sizeof(item));
+  for (j = 0; j < 3; j++)
+    push(stack, item);
+  for (j = 0; j < 3; j++)
+    pop(stack, out);
+  pop(stack, out);
+  ok = memcmp(out, first, sizeof(first)) == 0;
+  freeStack(stack);
+  return ok;
+}
+
+int main(void) {
+  unsigned char buf[MAX_SIZE];
+  size_t size;
+  int round;
+
+  for (round = 0; round < ROUNDS; round++) {
+    size = 1 + nextRandom() % (round < ROUNDS / 2 ? 300 : MAX_SIZE);
+    fillBuffer(buf, size);
+    if (!checkCodec(buf, size)) {
+      fprintf(stderr, "codec round trip failed, round %d size %zu\n", round,
+              size);
+      return 1;
+    }
+  }
+  for (round = 0; round < 100; round++) {
+    if (!checkStack()) {
+      fprintf(stderr, "compressed table came back corrupted\n");
+      return 1;
+    }
+  }
+  printf("lzRoundTrip: ok\n");
+  return 0;
+}
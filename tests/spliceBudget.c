@@ -0,0 +1,123 @@
+/******************************************************************************
+ *  Copyright (C) 2019 - Haohua Dong & Diogo Antunes
+ *
+ *  This file is a part of GeneralStack.
+ *
+ *  GeneralStack is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  GeneralStack is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * DESCRIPTION
+ *  Regression test of stackSplice against budgets: a budget refusing the copy
+ *  of dst's top table must give STACK_FULL and leave the budget as it was, and
+ *  a successful splice must move the bytes between budgets.
+ *
+ *  Build and run:
+ *      cc -O2 -o spliceBudget tests/spliceBudget.c generalStack.c -lm \
+ *          -pthread && ./spliceBudget
+ *
+ *****************************************************************************/
+
+#include "../generalStack.h"
+
+#include <stdio.h>
+
+/* Description: Pushes the values from..to-1 on a Stack of longs.
+ * */
+static void fill(Stack *stack, long from, long to) {
+  for (; from < to; from++)
+    push(stack, &from);
+}
+/* Description: Pops every item of a Stack of longs, expecting to-1 down to
+ * from.
+ * Return: 1 if the items came back in order, 0 otherwise.
+ * */
+static int drain(Stack *stack, long from, long to) {
+  long item;
+
+  while (!isStackEmpty(stack)) {
+    pop(stack, &item);
+    if (item != --to)
+      return 0;
+  }
+  return to == from;
+}
+/* Description: dst's budget takes src's tables but not the copy of dst's
+ * partially filled top table.
+ * Return: 1 if the splice failed cleanly, 0 otherwise.
+ * */
+static int checkRefused(void) {
+  StackBudget *budget;
+  Stack *dst, *src;
+  StackStatus status;
+  size_t used;
+  int ok;
+
+  budget = initStackBudget(8 * sizeof(long));
+  dst = initStack(4, sizeof(long));
+  src = initStack(4, sizeof(long));
+  setStackBudget(dst, budget);
+  fill(dst, 0, 2);
+  fill(src, 2, 6);
+  used = stackBudgetUsed(budget);
+
+  status = stackSplice(dst, src);
+  ok = status == STACK_FULL && stackBudgetUsed(budget) == used;
+  if (!ok)
+    fprintf(stderr, "refused splice: status %d, budget %zu, expected %zu\n",
+            (int)status, stackBudgetUsed(budget), used);
+  ok = ok && drain(src, 2, 6) && drain(dst, 0, 2);
+  freeStack(dst);
+  freeStack(src);
+  if (ok && stackBudgetUsed(budget) != 0) {
+    fprintf(stderr, "budget left at %zu\n", stackBudgetUsed(budget));
+    ok = 0;
+  }
+  freeStackBudget(budget);
+  return ok;
+}
+/* Description: Splices between two Stacks with budgets of their own.
+ * Return: 1 if the items and the budgets are right afterwards, 0 otherwise.
+ * */
+static int checkMoved(void) {
+  StackBudget *dstBudget, *srcBudget;
+  Stack *dst, *src;
+  int ok;
+
+  dstBudget = initStackBudget(1 << 20);
+  srcBudget = initStackBudget(1 << 20);
+  dst = initStack(4, sizeof(long));
+  src = initStack(4, sizeof(long));
+  setStackBudget(dst, dstBudget);
+  setStackBudget(src, srcBudget);
+  fill(dst, 0, 6);
+  fill(src, 6, 20);
+
+  ok = stackSplice(dst, src) == STACK_OK && isStackEmpty(src) &&
+       drain(dst, 0, 20);
+  freeStack(dst);
+  freeStack(src);
+  ok = ok && stackBudgetUsed(dstBudget) == 0 &&
+       stackBudgetUsed(srcBudget) == 0;
+  freeStackBudget(dstBudget);
+  freeStackBudget(srcBudget);
+  return ok;
+}
+
+int main(void) {
+  if (!checkRefused() || !checkMoved()) {
+    fprintf(stderr, "spliceBudget: failed\n");
+    return 1;
+  }
+  printf("spliceBudget: ok\n");
+  return 0;
+}